@@ -0,0 +1,135 @@
+#ifndef CHARON_ASSIGNMENT_TABLE_H
+#define CHARON_ASSIGNMENT_TABLE_H
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "hashing.hpp"
+
+// The categories called for the reads in an assignment file written by classify or dehost, restricted to the
+// categories to extract, and looked up by read id.
+//
+// Only a 64-bit hash of each read id is kept with the index of its category, 9 bytes per read, so the table stays small
+// for large runs. The chance that a read which is not in the table matches the hash of one which is, is about the number
+// of reads in the table / 2^64 per read, e.g. below 1 in 10^10 for 10^9 reads.
+class AssignmentTable {
+private:
+    std::vector<std::string> categories_{}; // extracted categories, in the order of their indices
+    std::unordered_map<std::string, uint8_t> category_indices_{};
+    bool all_categories_{false};
+
+    std::vector<uint64_t> hashes_{}; // sorted
+    std::vector<uint8_t> hash_categories_{};
+    uint64_t num_assignments_{0};
+
+    static uint64_t hash(const std::string_view read_id) {
+        return mix64(std::hash<std::string_view>{}(read_id));
+    }
+
+    // The index of call among the extracted categories, adding it if extracting all categories, or -1 if not extracted
+    int16_t category_index(const std::string_view call) {
+        const auto it = category_indices_.find(std::string(call));
+        if (it != category_indices_.end())
+            return it->second;
+        if (not all_categories_ or call.empty() or categories_.size() == std::numeric_limits<uint8_t>::max())
+            return -1;
+        categories_.emplace_back(call);
+        category_indices_.emplace(call, categories_.size() - 1);
+        return categories_.size() - 1;
+    }
+
+public:
+    AssignmentTable() = default;
+
+    AssignmentTable(AssignmentTable const &) = default;
+
+    AssignmentTable(AssignmentTable &&) = default;
+
+    AssignmentTable &operator=(AssignmentTable const &) = default;
+
+    AssignmentTable &operator=(AssignmentTable &&) = default;
+
+    ~AssignmentTable() = default;
+
+    // categories are the names of the categories to extract, "all" for every category called, and "unclassified" for
+    // the reads without a call
+    explicit AssignmentTable(const std::vector<std::string> &categories) {
+        for (const auto &category: categories) {
+            if (category == "all") {
+                all_categories_ = true;
+                continue;
+            }
+            if (category_indices_.contains(category))
+                continue;
+            categories_.push_back(category);
+            category_indices_.emplace(category == "unclassified" ? "" : category, categories_.size() - 1);
+        }
+    }
+
+    // Reads the assignment lines from assignments, calling visit(category index, read id) for each read in an
+    // extracted category. Lines are "status\tread_id\tcall\t...", with an empty call for unclassified reads.
+    template<typename visit_t>
+    void read(std::istream &assignments, visit_t &&visit) {
+        std::string line;
+        while (std::getline(assignments, line)) {
+            const std::string_view fields(line);
+            const auto id_start = fields.find('\t');
+            const auto call_start = id_start == std::string_view::npos ? id_start : fields.find('\t', id_start + 1);
+            if (call_start == std::string_view::npos)
+                continue;
+            num_assignments_ += 1;
+            const auto call_end = std::min(fields.find('\t', call_start + 1), fields.size());
+            const auto index = category_index(fields.substr(call_start + 1, call_end - call_start - 1));
+            if (index >= 0)
+                visit(static_cast<uint8_t>(index), fields.substr(id_start + 1, call_start - id_start - 1));
+        }
+    }
+
+    // Reads assignments and keeps the reads in extracted categories for lookups with find
+    void load(std::istream &assignments) {
+        std::vector<std::pair<uint64_t, uint8_t>> entries;
+        read(assignments, [&](const uint8_t index, const std::string_view read_id) {
+            entries.emplace_back(hash(read_id), index);
+        });
+        std::sort(entries.begin(), entries.end());
+        hashes_.resize(entries.size());
+        hash_categories_.resize(entries.size());
+        for (size_t i = 0; i < entries.size(); ++i) {
+            hashes_[i] = entries[i].first;
+            hash_categories_[i] = entries[i].second;
+        }
+    }
+
+    // The index of the category of the read, or -1 if it is not to be extracted
+    int16_t find(const std::string_view read_id) const {
+        const auto value = hash(read_id);
+        const auto it = std::lower_bound(hashes_.begin(), hashes_.end(), value);
+        if (it == hashes_.end() or *it != value)
+            return -1;
+        return hash_categories_[it - hashes_.begin()];
+    }
+
+    const std::vector<std::string> &categories() const {
+        return categories_;
+    }
+
+    uint64_t num_assignments() const {
+        return num_assignments_;
+    }
+
+    uint64_t size() const {
+        return hashes_.size();
+    }
+};
+
+#endif // CHARON_ASSIGNMENT_TABLE_H
@@ -0,0 +1,298 @@
+#ifndef CHARON_BLOCKED_BLOOM_FILTER_H
+#define CHARON_BLOCKED_BLOOM_FILTER_H
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cassert>
+#include <cmath>
+#include <new>
+#include <vector>
+
+#include <cereal/types/vector.hpp>
+#include <seqan3/core/concept/cereal.hpp>
+#include <plog/Log.h>
+
+#include "hashing.hpp"
+
+static constexpr size_t cache_line_bytes{64};
+
+template<typename T>
+struct CacheAlignedAllocator {
+    using value_type = T;
+
+    CacheAlignedAllocator() = default;
+
+    template<typename U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U> &) {}
+
+    T *allocate(const size_t n) {
+        return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t{cache_line_bytes}));
+    }
+
+    void deallocate(T *pointer, const size_t) {
+        ::operator delete(pointer, std::align_val_t{cache_line_bytes});
+    }
+
+    template<typename U>
+    bool operator==(const CacheAlignedAllocator<U> &) const {
+        return true;
+    }
+};
+
+// False positive rate of a blocked Bloom filter holding num_elements in num_blocks blocks of positions_per_block
+// positions each, with num_hash positions set per element. The number of elements per block is Poisson distributed and
+// the fuller blocks answer yes more often, so this is higher than for an unblocked filter of the same size, the more so
+// the fewer positions per block. Within a block it is exact, including hashes which repeat a position.
+inline double blocked_false_positive_rate(const uint64_t num_elements, const uint64_t num_blocks,
+                                          const uint32_t positions_per_block, const uint8_t num_hash) {
+    if (num_blocks == 0)
+        return 1.0;
+    if (num_elements == 0)
+        return 0.0;
+    const double positions = positions_per_block;
+
+    // probability that the num_hash positions of a query are num_distinct distinct positions
+    std::vector<double> distinct(num_hash + 1, 0.0);
+    distinct[0] = 1.0;
+    for (auto i = 0; i < num_hash; ++i) {
+        for (auto j = i + 1; j > 0; --j)
+            distinct[j] = distinct[j] * j / positions + distinct[j - 1] * (positions - j + 1) / positions;
+        distinct[0] = 0.0;
+    }
+
+    const double mean = static_cast<double>(num_elements) / num_blocks;
+    const auto max_in_block = static_cast<uint64_t>(mean + 12 * std::sqrt(mean) + 12);
+    double fpr = 0.0;
+    for (uint64_t i = 0; i <= max_in_block; ++i) {
+        // probability that given positions are all set after i elements, by inclusion-exclusion over unset positions
+        const double num_set = static_cast<double>(num_hash) * i;
+        double block_fpr = 0.0;
+        for (auto j = 1; j <= num_hash; ++j) {
+            double all_set = 0.0;
+            double binomial = 1.0;
+            for (auto l = 0; l <= j; ++l) {
+                all_set += (l % 2 ? -binomial : binomial) * std::pow(1.0 - l / positions, num_set);
+                binomial = binomial * (j - l) / (l + 1);
+            }
+            block_fpr += distinct[j] * all_set;
+        }
+        fpr += std::exp(-mean + i * std::log(mean) - std::lgamma(i + 1.0)) * block_fpr;
+    }
+    return std::clamp(fpr, 0.0, 1.0);
+}
+
+// Bloom filter over a small number of bins in which every hash function for a value selects a position within the
+// same 64 byte block. Each position holds one bit per bin (interleaved like the IBF), so a query touches a single
+// cache line rather than one per hash function, at the cost of a somewhat higher false positive rate.
+class BlockedBloomFilter {
+private:
+    static constexpr uint8_t words_per_block{cache_line_bytes / sizeof(uint64_t)};
+    static constexpr uint8_t bits_per_position_hash{21};
+
+    uint8_t num_bins_{0};
+    uint8_t num_words_{0}; // words per position, one bit per bin
+    uint8_t positions_per_block_{0};
+    uint8_t num_hash_{0};
+    uint64_t num_blocks_{0};
+    std::vector<uint64_t, CacheAlignedAllocator<uint64_t>> data_{};
+
+    template<typename on_position_t>
+    inline void for_each_position(const uint64_t value, on_position_t &&on_position) const {
+        constexpr uint64_t mask = (1ULL << bits_per_position_hash) - 1;
+        uint64_t bits = mix64(value ^ 0x9E3779B97F4A7C15ULL);
+        for (auto i = 0; i < num_hash_; ++i) {
+            const auto slice = i % 3;
+            if (i > 0 and slice == 0)
+                bits = mix64(bits);
+            const auto h = (bits >> (bits_per_position_hash * slice)) & mask;
+            on_position((h * positions_per_block_) >> bits_per_position_hash);
+        }
+    }
+
+public:
+    BlockedBloomFilter() = default;
+
+    BlockedBloomFilter(BlockedBloomFilter const &) = default;
+
+    BlockedBloomFilter(BlockedBloomFilter &&) = default;
+
+    BlockedBloomFilter &operator=(BlockedBloomFilter const &) = default;
+
+    BlockedBloomFilter &operator=(BlockedBloomFilter &&) = default;
+
+    ~BlockedBloomFilter() = default;
+
+    // bin_size is the number of positions per bin, as for the IBF
+    BlockedBloomFilter(const uint8_t num_bins, const uint64_t bin_size, const uint8_t num_hash) :
+            num_bins_{num_bins},
+            num_words_(static_cast<uint8_t>((num_bins + 63) / 64)),
+            positions_per_block_{positions_per_block(num_bins)},
+            num_hash_{num_hash} {
+        assert(num_bins > 0);
+        assert(bin_size > 0);
+        assert(num_words_ <= words_per_block);
+        num_blocks_ = (bin_size + positions_per_block_ - 1) / positions_per_block_;
+        data_.resize(num_blocks_ * words_per_block, 0);
+        if (positions_per_block_ < num_hash_)
+            PLOG_WARNING << "Blocked filter has only " << +positions_per_block_ << " positions per block for "
+                         << +num_hash_ << " hash functions, expect a high false positive rate";
+        PLOG_INFO << "Created blocked filter with " << num_blocks_ << " blocks of " << +positions_per_block_
+                  << " positions";
+    }
+
+    // positions in each 64 byte block for a filter with num_bins bins, each position holding one bit per bin
+    static uint8_t positions_per_block(const uint8_t num_bins) {
+        return words_per_block / ((num_bins + 63) / 64);
+    }
+
+    uint8_t bin_count() const {
+        return num_bins_;
+    }
+
+    uint8_t num_words() const {
+        return num_words_;
+    }
+
+    // expected false positive rate of a bin holding num_elements values
+    double false_positive_rate(const uint64_t num_elements) const {
+        return blocked_false_positive_rate(num_elements, num_blocks_, positions_per_block_, num_hash_);
+    }
+
+    uint64_t size_in_bytes() const {
+        return data_.size() * sizeof(uint64_t);
+    }
+
+    inline uint64_t block_index(const uint64_t value) const {
+        return fit64(mix64(value), num_blocks_);
+    }
+
+    inline const uint64_t *block(const uint64_t value) const {
+        return data_.data() + block_index(value) * words_per_block;
+    }
+
+    void emplace(const uint64_t value, const uint8_t bin) {
+        assert(bin < num_bins_);
+        auto *target = data_.data() + block_index(value) * words_per_block;
+        const auto word = bin >> 6;
+        const auto bit = 1ULL << (bin & 63);
+        for_each_position(value, [&](const uint64_t position) {
+            target[position * num_words_ + word] |= bit;
+        });
+    }
+
+    // Writes num_words() words to result with a 1 for each bin which may contain the value
+    inline const uint64_t *bulk_contains(const uint64_t value, uint64_t *result) const {
+        const auto *source = block(value);
+        for (auto word = 0; word < num_words_; ++word)
+            result[word] = ~0ULL;
+        for_each_position(value, [&](const uint64_t position) {
+            const auto *bits = source + position * num_words_;
+            for (auto word = 0; word < num_words_; ++word)
+                result[word] &= bits[word];
+        });
+        return result;
+    }
+
+    template<seqan3::cereal_archive archive_t>
+    void CEREAL_SERIALIZE_FUNCTION_NAME(archive_t &archive) {
+        archive(num_bins_);
+        archive(num_words_);
+        archive(positions_per_block_);
+        archive(num_hash_);
+        archive(num_blocks_);
+        archive(data_);
+    }
+};
+
+// Blocked Bloom filter for a single set, used for the host prefilter. BlockedBloomFilter gives every position a word so
+// it can hold a bit per bin, which for one bin wastes 63 of every 64 bits and leaves only 8 positions per block. Here
+// every bit of a 64 byte block is a position, so the hashes of a value are spread over 512 positions and the filter is
+// 64 times smaller for the same number of positions.
+class SingleBinBlockedBloomFilter {
+private:
+    static constexpr uint8_t words_per_block{cache_line_bytes / sizeof(uint64_t)};
+    static constexpr uint8_t bits_per_position_hash{9};
+    static constexpr uint8_t position_hashes_per_mix{64 / bits_per_position_hash};
+
+    uint8_t num_hash_{0};
+    uint64_t num_blocks_{0};
+    std::vector<uint64_t, CacheAlignedAllocator<uint64_t>> data_{};
+
+    template<typename on_position_t>
+    inline void for_each_position(const uint64_t value, on_position_t &&on_position) const {
+        constexpr uint64_t mask = (1ULL << bits_per_position_hash) - 1;
+        uint64_t bits = mix64(value ^ 0x9E3779B97F4A7C15ULL);
+        for (auto i = 0; i < num_hash_; ++i) {
+            const auto slice = i % position_hashes_per_mix;
+            if (i > 0 and slice == 0)
+                bits = mix64(bits);
+            on_position((bits >> (bits_per_position_hash * slice)) & mask);
+        }
+    }
+
+public:
+    static constexpr uint32_t positions_per_block{cache_line_bytes * 8};
+
+    SingleBinBlockedBloomFilter() = default;
+
+    SingleBinBlockedBloomFilter(SingleBinBlockedBloomFilter const &) = default;
+
+    SingleBinBlockedBloomFilter(SingleBinBlockedBloomFilter &&) = default;
+
+    SingleBinBlockedBloomFilter &operator=(SingleBinBlockedBloomFilter const &) = default;
+
+    SingleBinBlockedBloomFilter &operator=(SingleBinBlockedBloomFilter &&) = default;
+
+    ~SingleBinBlockedBloomFilter() = default;
+
+    SingleBinBlockedBloomFilter(const uint64_t num_bits, const uint8_t num_hash) :
+            num_hash_{num_hash},
+            num_blocks_{(num_bits + positions_per_block - 1) / positions_per_block} {
+        assert(num_bits > 0);
+        data_.resize(num_blocks_ * words_per_block, 0);
+    }
+
+    bool empty() const {
+        return num_blocks_ == 0;
+    }
+
+    uint64_t size_in_bytes() const {
+        return data_.size() * sizeof(uint64_t);
+    }
+
+    // expected false positive rate once holding num_elements values
+    double false_positive_rate(const uint64_t num_elements) const {
+        return blocked_false_positive_rate(num_elements, num_blocks_, positions_per_block, num_hash_);
+    }
+
+    inline const uint64_t *block(const uint64_t value) const {
+        return data_.data() + fit64(mix64(value), num_blocks_) * words_per_block;
+    }
+
+    void emplace(const uint64_t value) {
+        auto *target = data_.data() + fit64(mix64(value), num_blocks_) * words_per_block;
+        for_each_position(value, [&](const uint64_t position) {
+            target[position >> 6] |= 1ULL << (position & 63);
+        });
+    }
+
+    inline bool contains(const uint64_t value) const {
+        const auto *source = block(value);
+        bool found = true;
+        for_each_position(value, [&](const uint64_t position) {
+            found &= (source[position >> 6] >> (position & 63)) & 1ULL;
+        });
+        return found;
+    }
+
+    template<seqan3::cereal_archive archive_t>
+    void CEREAL_SERIALIZE_FUNCTION_NAME(archive_t &archive) {
+        archive(num_hash_);
+        archive(num_blocks_);
+        archive(data_);
+    }
+};
+
+#endif // CHARON_BLOCKED_BLOOM_FILTER_H
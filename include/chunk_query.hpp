@@ -0,0 +1,80 @@
+#ifndef CHARON_CHUNK_QUERY_H
+#define CHARON_CHUNK_QUERY_H
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "hit_matrix.hpp"
+
+// Looks up the minimisers of all reads in a chunk together. Rather than querying each read in turn, the minimisers of
+// every read are sorted by where their lookup lands in the index and queried in that order, so cache lines and pages
+// are reused by minimisers from different reads. The hits are scattered back to one row per minimiser in read order,
+// and the rows of read i are given by view(i).
+class ChunkQuery {
+private:
+    std::vector<uint32_t> offsets_{}; // rows of read i are offsets_[i] to offsets_[i + 1]
+    std::vector<uint64_t> values_{}; // minimisers of all reads in read order
+    std::vector<std::pair<uint64_t, uint32_t>> order_{}; // (locality key, row) sorted by key
+    std::vector<uint64_t> sorted_values_{};
+    HitMatrix sorted_hits_{}; // hits in sorted order
+    HitMatrix hits_{};
+
+public:
+    ChunkQuery() = default;
+
+    ChunkQuery(ChunkQuery const &) = default;
+
+    ChunkQuery(ChunkQuery &&) = default;
+
+    ChunkQuery &operator=(ChunkQuery const &) = default;
+
+    ChunkQuery &operator=(ChunkQuery &&) = default;
+
+    ~ChunkQuery() = default;
+
+    uint32_t num_rows() const {
+        return hits_.num_rows();
+    }
+
+    HitMatrixView view(const size_t read) const {
+        return hits_.view(offsets_[read], offsets_[read + 1] - offsets_[read]);
+    }
+
+    template<typename agent_t>
+    void run(agent_t &agent, const std::vector<std::vector<uint64_t>> &read_values, const uint16_t num_words) {
+        offsets_.resize(read_values.size() + 1);
+        offsets_[0] = 0;
+        for (auto i = 0; i < read_values.size(); ++i)
+            offsets_[i + 1] = offsets_[i] + read_values[i].size();
+        const auto num_rows = offsets_.back();
+
+        values_.resize(num_rows);
+        for (auto i = 0; i < read_values.size(); ++i)
+            std::copy(read_values[i].begin(), read_values[i].end(), values_.begin() + offsets_[i]);
+
+        order_.resize(num_rows);
+        for (uint32_t row = 0; row < num_rows; ++row)
+            order_[row] = {agent.locality_key(values_[row]), row};
+        std::sort(order_.begin(), order_.end());
+
+        sorted_values_.resize(num_rows);
+        for (uint32_t k = 0; k < num_rows; ++k)
+            sorted_values_[k] = values_[order_[k].second];
+
+        // query the sorted minimisers, then scatter the rows back to their reads
+        sorted_hits_.reset(num_words, num_rows);
+        agent.bulk_contains(std::span<const uint64_t>(sorted_values_), sorted_hits_);
+        hits_.resize(num_words, num_rows);
+        for (uint32_t k = 0; k < num_rows; ++k) {
+            const auto *source = sorted_hits_.view().row(k);
+            std::copy(source, source + num_words, hits_.row(order_[k].second));
+        }
+    }
+};
+
+#endif // CHARON_CHUNK_QUERY_H
@@ -12,8 +12,14 @@ struct ClassifyArguments {
     std::filesystem::path read_file;
     std::filesystem::path read_file2;
     bool is_paired{false};
-    std::string db;
-    uint8_t chunk_size{100};
+    std::vector<std::string> db;
+    std::string layout{"auto"};
+    bool sort_queries{false};
+    uint32_t max_minimisers{0};
+    std::string subsample{"hash"};
+    uint32_t chunk_size{1000};
+    uint64_t batch_bases{1000000};
+    uint32_t split_length{100000};
 
 
     // Stats options
@@ -24,6 +30,7 @@ struct ClassifyArguments {
     // thresholds for filtering
     float min_quality{10.0};
     uint32_t min_length{140};
+    std::string complexity{"estimate"};
     float min_compression{0.15};
     uint8_t confidence_threshold{2};
     float min_proportion_difference{0.00};
@@ -32,11 +39,15 @@ struct ClassifyArguments {
     bool run_extract{false};
     std::string category_to_extract;
     std::string prefix;
+    uint8_t compression_level{6};
+    std::string output;
+    bool ordered{false};
     std::unordered_map<uint8_t, std::vector<std::filesystem::path>> extract_category_to_file;
 
     // General options
     std::string log_file{"charon.log"};
     uint8_t threads{1};
+    uint8_t decompression_threads{4};
     uint8_t verbosity{0};
 
     std::string to_string() {
@@ -44,9 +55,16 @@ struct ClassifyArguments {
 
         ss += "\n\nClassify Arguments:\n\n";
         ss += "\tread_file:\t\t" + read_file.string() + "\n";
-        ss += "\tdb:\t\t\t" + db + "\n\n";
+        for (const auto &db_file: db)
+            ss += "\tdb:\t\t\t" + db_file + "\n";
+        ss += "\tlayout:\t\t\t" + layout + "\n";
+        ss += "\tsort_queries:\t\t\t" + std::to_string(sort_queries) + "\n";
+        ss += "\tmax_minimisers:\t\t" + std::to_string(max_minimisers) + "\n";
+        ss += "\tsubsample:\t\t" + subsample + "\n\n";
 
-        ss += "\tchunk_size:\t\t" + std::to_string(chunk_size) + "\n\n";
+        ss += "\tchunk_size:\t\t" + std::to_string(chunk_size) + "\n";
+        ss += "\tbatch_bases:\t\t" + std::to_string(batch_bases) + "\n";
+        ss += "\tsplit_length:\t\t" + std::to_string(split_length) + "\n\n";
 
         ss += "\tlo_hi_threshold:\t\t" + std::to_string(lo_hi_threshold) + "\n";
         ss += "\tnum_reads_to_fit:\t" + std::to_string(num_reads_to_fit) + "\n";
@@ -54,15 +72,20 @@ struct ClassifyArguments {
 
         ss += "\tmin_length:\t\t" + std::to_string(min_length) + "\n";
         ss += "\tmin_quality:\t\t" + std::to_string(min_quality) + "\n";
+        ss += "\tcomplexity:\t\t\t" + complexity + "\n";
         ss += "\tmin_compression:\t\t" + std::to_string(min_compression) + "\n";
         ss += "\tconfidence_threshold:\t" + std::to_string(confidence_threshold) + "\n";
         ss += "\tmin_proportion_diff:\t\t" + std::to_string(min_proportion_difference) + "\n\n";
 
         ss += "\tcategory_to_extract:\t" + category_to_extract + "\n";
-        ss += "\tprefix:\t" + prefix + "\n\n";
+        ss += "\tprefix:\t" + prefix + "\n";
+        ss += "\tcompression_level:\t" + std::to_string(compression_level) + "\n";
+        ss += "\toutput:\t\t\t" + output + "\n";
+        ss += "\tordered:\t\t" + std::to_string(ordered) + "\n\n";
 
         ss += "\tlog_file:\t\t" + log_file + "\n";
         ss += "\tthreads:\t\t" + std::to_string(threads) + "\n";
+        ss += "\tdecompression_threads:\t" + std::to_string(decompression_threads) + "\n";
         ss += "\tverbosity:\t\t" + std::to_string(verbosity) + "\n\n";
 
         return ss;
@@ -10,13 +10,13 @@
 
 #include "result.hpp"
 
-class Index;
+class IndexSet;
 
 struct ClassifyArguments;
 
 void setup_classify_subcommand(CLI::App &app);
 
-void classify_reads(const ClassifyArguments &opt, const Index &index);
+void classify_reads(const ClassifyArguments &opt, const IndexSet &index);
 
 int classify_main(ClassifyArguments &opt);
 
@@ -388,6 +388,19 @@ public:
         return ProbPair(p_pos / total, (p_err + p_neg) / total);
     }
 
+    // Expected read proportion under the positive (or negative) distribution
+    double mean(const bool pos) const {
+        if (dist == "kde")
+            return ::mean(pos ? k_pos.dataset : k_neg.dataset);
+        else if (dist == "beta") {
+            const auto &params = pos ? b_pos : b_neg;
+            return params.alpha / (params.alpha + params.beta);
+        } else {
+            const auto &params = pos ? g_pos : g_neg;
+            return params.loc + params.shape * params.scale;
+        }
+    }
+
     friend class StatsModel;
 
 };
@@ -518,6 +531,14 @@ public:
         return min_prob_difference_;
     }
 
+    double pos_mean(const uint8_t i) const {
+        return models_.at(i).mean(true);
+    }
+
+    double neg_mean(const uint8_t i) const {
+        return models_.at(i).mean(false);
+    }
+
     void train_model_at(const uint8_t &i) {
         PLOG_DEBUG << "Train model at position " << +i;
         auto &data = training_data_[i];
@@ -0,0 +1,149 @@
+#ifndef CHARON_COMPLEXITY_H
+#define CHARON_COMPLEXITY_H
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <seqan3/alphabet/nucleotide/dna5.hpp>
+
+// Estimates the gzip compression ratio of a read (compressed size / read length) without compressing it, for use with
+// --min_compression.
+//
+// The read is parsed the way gzip's LZ77 stage would, but greedily and remembering only the last position of each
+// 6-mer: at each position, if the 6-mer starting there was last seen within gzip's 32kb window, the match is extended
+// as far as it goes (at most 258 bases) and skipped, otherwise the base is a literal. The compressed size in bytes
+// is then
+//     0.2023 * literals * H + 1.848 * matches + 0.05427 * sum(log2 distance) - 0.2045 * sum(log2 length) + 33.41
+// where H is the Shannon entropy of the base composition. This was fitted against gzip (default level, with header) on
+// simulated reads of 150bp to 10kb ranging from random to skewed compositions, tandem repeats with up to 30% mutation
+// and mixtures of these. On held out reads the mean absolute error was 0.013, and 0.014 for reads with a gzip ratio
+// between 0.1 and 0.2, with 1.2% of reads on the other side of classify's default --min_compression of 0.15 (7.5% for
+// the 3-mer entropy estimate used before). gzip's lazy matching and Huffman coding are not modelled, so individual
+// reads, especially short ones, can still differ from gzip by 0.05 or more.
+class ComplexityEstimator {
+private:
+    static constexpr uint8_t kmer_size{6};
+    static constexpr uint32_t num_kmers{1u << (2 * kmer_size)};
+    static constexpr uint32_t window{32768};
+    static constexpr uint32_t max_match{258};
+    static constexpr double literal_bytes_per_bit{0.2023};
+    static constexpr double match_bytes{1.848};
+    static constexpr double bytes_per_log_distance{0.05427};
+    static constexpr double bytes_per_log_length{-0.2045};
+    static constexpr double overhead_bytes{33.41};
+    static constexpr std::array<uint8_t, 5> two_bit_rank{0, 1, 2, 4, 3}; // dna5 ranks are A, C, G, N, T, N is 4
+
+    std::array<uint32_t, 4> base_counts_{};
+    std::vector<uint8_t> bases_{}; // two bit ranks of the current read, 4 for N
+    std::vector<int32_t> kmers_{}; // the 6-mer starting at each base, -1 if it runs into an N or the end
+    // last position of each 6-mer, counted across reads from offset_ so that positions in earlier reads are stale
+    std::vector<uint64_t> last_ = std::vector<uint64_t>(num_kmers, 0);
+    uint64_t offset_{1};
+
+    template<typename sequence_t>
+    void add(const sequence_t &sequence) {
+        for (const auto &base: sequence) {
+            const auto rank = two_bit_rank[seqan3::to_rank(base)];
+            bases_.push_back(rank);
+            if (rank < 4)
+                base_counts_[rank] += 1;
+        }
+    }
+
+    float estimate() {
+        const auto num_bases = bases_.size();
+        if (num_bases == 0)
+            return 0;
+
+        double entropy = 0;
+        const double num_counted = base_counts_[0] + base_counts_[1] + base_counts_[2] + base_counts_[3];
+        for (const auto &count: base_counts_) {
+            if (count > 0)
+                entropy -= count / num_counted * std::log2(count / num_counted);
+        }
+
+        kmers_.assign(num_bases, -1);
+        uint32_t kmer = 0;
+        uint8_t valid = 0; // number of consecutive bases (up to kmer_size) since the last N
+        for (size_t i = 0; i < num_bases; ++i) {
+            if (bases_[i] > 3) {
+                valid = 0;
+                continue;
+            }
+            kmer = ((kmer << 2) | bases_[i]) & (num_kmers - 1);
+            valid = std::min<uint8_t>(valid + 1, kmer_size);
+            if (valid == kmer_size)
+                kmers_[i + 1 - kmer_size] = kmer;
+        }
+
+        uint64_t num_literals = 0;
+        uint64_t num_matches = 0;
+        double log_distances = 0;
+        double log_lengths = 0;
+        size_t i = 0;
+        while (i < num_bases) {
+            if (kmers_[i] >= 0) {
+                auto &last = last_[kmers_[i]];
+                const auto previous = last;
+                last = offset_ + i;
+                if (previous >= offset_ and offset_ + i - previous <= window) {
+                    const auto start = previous - offset_;
+                    size_t length = kmer_size;
+                    while (i + length < num_bases and length < max_match and
+                           bases_[start + length] == bases_[i + length])
+                        length += 1;
+                    for (auto position = i + 1; position < i + length; ++position) {
+                        if (kmers_[position] >= 0)
+                            last_[kmers_[position]] = offset_ + position;
+                    }
+                    num_matches += 1;
+                    log_distances += std::log2(static_cast<double>(i - start));
+                    log_lengths += std::log2(static_cast<double>(length));
+                    i += length;
+                    continue;
+                }
+            }
+            num_literals += 1;
+            i += 1;
+        }
+
+        const auto bytes = literal_bytes_per_bit * num_literals * entropy + match_bytes * num_matches +
+                           bytes_per_log_distance * log_distances + bytes_per_log_length * log_lengths + overhead_bytes;
+        return bytes / num_bases;
+    }
+
+    void reset() {
+        offset_ += bases_.size();
+        bases_.clear();
+        base_counts_.fill(0);
+    }
+
+public:
+    ComplexityEstimator() = default;
+
+    ComplexityEstimator(ComplexityEstimator const &) = default;
+
+    ComplexityEstimator(ComplexityEstimator &&) = default;
+
+    ComplexityEstimator &operator=(ComplexityEstimator const &) = default;
+
+    ComplexityEstimator &operator=(ComplexityEstimator &&) = default;
+
+    ~ComplexityEstimator() = default;
+
+    // Estimated compression ratio of the given sequences (ranges of dna5) taken together, e.g. both mates of a pair
+    template<typename... sequence_t>
+    float compression_ratio(const sequence_t &... sequences) {
+        (add(sequences), ...);
+        const auto ratio = estimate();
+        reset();
+        return ratio;
+    }
+};
+
+#endif // CHARON_COMPLEXITY_H
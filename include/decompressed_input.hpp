@@ -0,0 +1,403 @@
+#ifndef CHARON_DECOMPRESSED_INPUT_H
+#define CHARON_DECOMPRESSED_INPUT_H
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <istream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <bzlib.h>
+#include <zlib.h>
+
+#include <plog/Log.h>
+
+#include "fastx_reader.hpp"
+#include "read_pipeline.hpp"
+
+// Decompresses a gzipped or bzip2 compressed read file on threads of its own, for the parser to read as an
+// uncompressed stream.
+//
+// BGZF files (e.g. from bgzip) are made of independent blocks of at most 64 KB, which are grouped into chunks of about
+// chunk_size compressed bytes and inflated in parallel by num_threads threads. Any other gzip file has to be inflated
+// from start to end, which is done on one thread; the parser then at least does not wait for it, as it inflates the
+// next chunk while the last is parsed, and likewise for bzip2 files. Either way chunks are handed to the parser in order through the stream buffer,
+// which reads straight out of the inflated chunk rather than copying it. At most 2 * num_threads + 2 chunks are kept
+// in memory, so decompression stops when the parser falls behind.
+//
+// Files which are not compressed are read directly.
+class DecompressedInput {
+private:
+    static constexpr size_t chunk_size{1 << 20};
+    static constexpr size_t max_bgzf_block_size{1 << 16};
+
+    struct Chunk {
+        std::string input;
+        std::string output;
+        std::promise<void> inflated;
+        std::future<void> ready{inflated.get_future()};
+    };
+
+    // Hands the parser the inflated chunks in order
+    class ChunkBuffer : public std::streambuf {
+    private:
+        DecompressedInput &input_;
+        std::shared_ptr<Chunk> chunk_{};
+
+    public:
+        explicit ChunkBuffer(DecompressedInput &input) :
+                input_(input) {}
+
+    protected:
+        int_type underflow() override {
+            if (gptr() < egptr())
+                return traits_type::to_int_type(*gptr());
+            do {
+                chunk_.reset();
+                if (not input_.in_order_.pop(chunk_))
+                    return traits_type::eof();
+                chunk_->ready.wait();
+            } while (chunk_->output.empty());
+            auto data = chunk_->output.data();
+            setg(data, data, data + chunk_->output.size());
+            return traits_type::to_int_type(*gptr());
+        }
+    };
+
+    std::filesystem::path path_{};
+    bool is_gzip_{false};
+    bool is_bgzf_{false};
+    bool is_bzip2_{false};
+    uint8_t num_threads_{1};
+
+    BoundedQueue<std::shared_ptr<Chunk>> in_order_; // chunks in file order, for the parser
+    BoundedQueue<std::shared_ptr<Chunk>> to_inflate_; // BGZF chunks waiting for an inflate thread
+    std::thread reader_;
+    std::vector<std::thread> inflaters_{};
+    ChunkBuffer buffer_;
+    std::istream stream_;
+    std::ifstream plain_file_{}; // read directly if not compressed
+
+    uint64_t num_bytes_in_{0};
+    std::vector<uint64_t> thread_bytes_out_{};
+    std::vector<double> thread_seconds_{};
+    std::chrono::steady_clock::time_point start_{};
+
+    [[noreturn]] void fail(const std::string &message) const {
+        PLOG_ERROR << "Failed to read " << path_ << ": " << message;
+        exit(1);
+    }
+
+    // The size of the BGZF block starting with header, or 0 if it is not a BGZF block. header must hold at least 18
+    // bytes, and the extra field with the block size must come within them as it does in files written by bgzip.
+    static size_t bgzf_block_size(const uint8_t *header) {
+        if (header[0] != 0x1f or header[1] != 0x8b or header[2] != 8 or not(header[3] & 4))
+            return 0;
+        if (header[12] != 'B' or header[13] != 'C' or header[14] != 2 or header[15] != 0)
+            return 0;
+        return (header[16] | header[17] << 8) + 1;
+    }
+
+    // Inflates the BGZF blocks of chunk.input into chunk.output, checking the size and CRC of each
+    void inflate_bgzf(z_stream &stream, Chunk &chunk) {
+        const auto *data = reinterpret_cast<const uint8_t *>(chunk.input.data());
+        size_t offset = 0;
+        while (offset < chunk.input.size()) {
+            const auto block_size = bgzf_block_size(data + offset);
+            const auto header_size = 12 + (data[offset + 10] | data[offset + 11] << 8);
+            const auto *trailer = data + offset + block_size - 8;
+            const uint32_t crc = trailer[0] | trailer[1] << 8 | trailer[2] << 16 | uint32_t(trailer[3]) << 24;
+            const uint32_t size = trailer[4] | trailer[5] << 8 | trailer[6] << 16 | uint32_t(trailer[7]) << 24;
+
+            const auto first = chunk.output.size();
+            chunk.output.resize(first + size);
+            auto *out = reinterpret_cast<Bytef *>(chunk.output.data() + first);
+            inflateReset(&stream);
+            stream.next_in = data + offset + header_size;
+            stream.avail_in = block_size - header_size - 8;
+            stream.next_out = out;
+            stream.avail_out = size;
+            if (inflate(&stream, Z_FINISH) != Z_STREAM_END or stream.avail_out != 0)
+                fail("corrupt BGZF block at offset " + std::to_string(offset) + " of a chunk");
+            if (crc32(crc32(0L, Z_NULL, 0), out, size) != crc)
+                fail("CRC mismatch in BGZF block");
+            offset += block_size;
+        }
+    }
+
+    // Reads whole BGZF blocks into chunks of about chunk_size bytes, queued both for the inflate threads and in order
+    void read_bgzf(std::ifstream &file) {
+        std::array<uint8_t, 18> header{};
+        auto chunk = std::make_shared<Chunk>();
+        auto push_chunk = [&]() {
+            in_order_.push(std::shared_ptr<Chunk>(chunk));
+            to_inflate_.push(std::move(chunk));
+            chunk = std::make_shared<Chunk>();
+        };
+
+        while (file.read(reinterpret_cast<char *>(header.data()), header.size())) {
+            const auto block_size = bgzf_block_size(header.data());
+            if (block_size < header.size() + 8 or block_size > max_bgzf_block_size)
+                fail("not a BGZF block at offset " + std::to_string(num_bytes_in_));
+            const auto first = chunk->input.size();
+            chunk->input.resize(first + block_size);
+            std::copy(header.begin(), header.end(), chunk->input.begin() + first);
+            if (not file.read(chunk->input.data() + first + header.size(), block_size - header.size()))
+                fail("truncated BGZF block");
+            num_bytes_in_ += block_size;
+            if (chunk->input.size() >= chunk_size)
+                push_chunk();
+        }
+        if (file.gcount() != 0)
+            fail("truncated BGZF block");
+        if (not chunk->input.empty())
+            push_chunk();
+    }
+
+    // Inflates any gzip file from start to end into chunks of about 4 * chunk_size bytes, including files made of
+    // several gzip members one after the other
+    void read_gzip(std::ifstream &file) {
+        const auto start = std::chrono::steady_clock::now();
+        z_stream stream{};
+        if (inflateInit2(&stream, 15 + 16) != Z_OK)
+            fail("could not initialise zlib");
+
+        std::string input(chunk_size, '\0');
+        auto chunk = std::make_shared<Chunk>();
+        double waiting_seconds = 0; // for the parser to take chunks, which is not counted as busy
+        auto push_chunk = [&]() {
+            thread_bytes_out_[0] += chunk->output.size();
+            chunk->inflated.set_value();
+            const auto push_start = std::chrono::steady_clock::now();
+            in_order_.push(std::move(chunk));
+            waiting_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - push_start).count();
+            chunk = std::make_shared<Chunk>();
+        };
+
+        int status = Z_OK;
+        size_t used = 0; // bytes of the output of chunk filled so far
+        while (file) {
+            file.read(input.data(), input.size());
+            stream.next_in = reinterpret_cast<const Bytef *>(input.data());
+            stream.avail_in = file.gcount();
+            num_bytes_in_ += file.gcount();
+            while (stream.avail_in > 0) {
+                if (status == Z_STREAM_END) {
+                    // the next gzip member
+                    inflateReset(&stream);
+                }
+                if (chunk->output.empty())
+                    chunk->output.resize(4 * chunk_size);
+                stream.next_out = reinterpret_cast<Bytef *>(chunk->output.data() + used);
+                stream.avail_out = chunk->output.size() - used;
+                status = inflate(&stream, Z_NO_FLUSH);
+                if (status != Z_OK and status != Z_STREAM_END)
+                    fail(stream.msg != nullptr ? stream.msg : "corrupt gzip data");
+                used = chunk->output.size() - stream.avail_out;
+                if (used == chunk->output.size()) {
+                    push_chunk();
+                    used = 0;
+                }
+            }
+        }
+        if (status != Z_STREAM_END)
+            fail("truncated gzip data");
+        if (used > 0) {
+            chunk->output.resize(used);
+            push_chunk();
+        }
+        inflateEnd(&stream);
+        thread_seconds_[0] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() -
+                              waiting_seconds;
+    }
+
+    // Inflates a bzip2 file from start to end into chunks of about 4 * chunk_size bytes, including files made of several
+    // bzip2 streams one after the other, as written by parallel compressors such as pbzip2
+    void read_bzip2(std::ifstream &file) {
+        const auto start = std::chrono::steady_clock::now();
+        bz_stream stream{};
+        if (BZ2_bzDecompressInit(&stream, 0, 0) != BZ_OK)
+            fail("could not initialise bzip2");
+
+        std::string input(chunk_size, '\0');
+        auto chunk = std::make_shared<Chunk>();
+        double waiting_seconds = 0; // for the parser to take chunks, which is not counted as busy
+        auto push_chunk = [&]() {
+            thread_bytes_out_[0] += chunk->output.size();
+            chunk->inflated.set_value();
+            const auto push_start = std::chrono::steady_clock::now();
+            in_order_.push(std::move(chunk));
+            waiting_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - push_start).count();
+            chunk = std::make_shared<Chunk>();
+        };
+
+        int status = BZ_OK;
+        size_t used = 0; // bytes of the output of chunk filled so far
+        while (file) {
+            file.read(input.data(), input.size());
+            stream.next_in = input.data();
+            stream.avail_in = file.gcount();
+            num_bytes_in_ += file.gcount();
+            while (stream.avail_in > 0) {
+                if (status == BZ_STREAM_END) {
+                    // the next bzip2 stream
+                    BZ2_bzDecompressEnd(&stream);
+                    if (BZ2_bzDecompressInit(&stream, 0, 0) != BZ_OK)
+                        fail("could not initialise bzip2");
+                }
+                if (chunk->output.empty())
+                    chunk->output.resize(4 * chunk_size);
+                stream.next_out = chunk->output.data() + used;
+                stream.avail_out = chunk->output.size() - used;
+                status = BZ2_bzDecompress(&stream);
+                if (status != BZ_OK and status != BZ_STREAM_END)
+                    fail("corrupt bzip2 data");
+                used = chunk->output.size() - stream.avail_out;
+                if (used == chunk->output.size()) {
+                    push_chunk();
+                    used = 0;
+                }
+            }
+        }
+        if (status != BZ_STREAM_END)
+            fail("truncated bzip2 data");
+        if (used > 0) {
+            chunk->output.resize(used);
+            push_chunk();
+        }
+        BZ2_bzDecompressEnd(&stream);
+        thread_seconds_[0] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() -
+                              waiting_seconds;
+    }
+
+    void read() {
+        std::ifstream file(path_, std::ios::binary);
+        if (not file)
+            fail("could not open the file");
+        if (is_bgzf_)
+            read_bgzf(file);
+        else if (is_bzip2_)
+            read_bzip2(file);
+        else
+            read_gzip(file);
+        to_inflate_.close();
+        in_order_.close();
+    }
+
+    void inflate_chunks(const uint8_t thread) {
+        z_stream stream{};
+        if (inflateInit2(&stream, -15) != Z_OK)
+            fail("could not initialise zlib");
+        std::shared_ptr<Chunk> chunk;
+        while (to_inflate_.pop(chunk)) {
+            const auto start = std::chrono::steady_clock::now();
+            inflate_bgzf(stream, *chunk);
+            thread_bytes_out_[thread] += chunk->output.size();
+            thread_seconds_[thread] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            chunk->input = std::string();
+            chunk->inflated.set_value();
+            chunk.reset();
+        }
+        inflateEnd(&stream);
+    }
+
+public:
+    DecompressedInput(const std::filesystem::path &path, const uint8_t num_threads) :
+            path_(path),
+            num_threads_(std::max<uint8_t>(num_threads, 1)),
+            in_order_(2 * num_threads_ + 2),
+            to_inflate_(num_threads_),
+            buffer_(*this),
+            stream_(&buffer_) {
+        std::array<uint8_t, 18> header{};
+        std::ifstream file(path_, std::ios::binary);
+        file.read(reinterpret_cast<char *>(header.data()), header.size());
+        is_gzip_ = file.gcount() >= 2 and header[0] == 0x1f and header[1] == 0x8b;
+        is_bgzf_ = file.gcount() == header.size() and bgzf_block_size(header.data()) != 0;
+        is_bzip2_ = file.gcount() >= 3 and header[0] == 'B' and header[1] == 'Z' and header[2] == 'h';
+        if (not is_gzip_ and not is_bzip2_) {
+            in_order_.close();
+            plain_file_.open(path_);
+            if (not plain_file_)
+                fail("could not open the file");
+            return;
+        }
+
+        if (not is_bgzf_)
+            num_threads_ = 1;
+        thread_bytes_out_.assign(num_threads_, 0);
+        thread_seconds_.assign(num_threads_, 0);
+        start_ = std::chrono::steady_clock::now();
+        reader_ = std::thread(&DecompressedInput::read, this);
+        if (is_bgzf_) {
+            for (uint8_t thread = 0; thread < num_threads_; ++thread)
+                inflaters_.emplace_back(&DecompressedInput::inflate_chunks, this, thread);
+        }
+    }
+
+    DecompressedInput(DecompressedInput const &) = delete;
+
+    DecompressedInput &operator=(DecompressedInput const &) = delete;
+
+    ~DecompressedInput() {
+        close();
+    }
+
+    bool is_gzip() const {
+        return is_gzip_;
+    }
+
+    bool is_bzip2() const {
+        return is_bzip2_;
+    }
+
+    // Opens the reads for parsing, from the decompressed stream if compressed and otherwise from the file
+    FastxReader open() {
+        return FastxReader(stream());
+    }
+
+    // The decompressed contents of the file, or the file itself if not compressed
+    std::istream &stream() {
+        if (not is_gzip_ and not is_bzip2_)
+            return plain_file_;
+        return stream_;
+    }
+
+    // Waits for the decompression threads, which have finished once the parser has read the whole stream, and logs
+    // the throughput
+    void close() {
+        if (not reader_.joinable())
+            return;
+        reader_.join();
+        for (auto &thread: inflaters_)
+            thread.join();
+        inflaters_.clear();
+
+        const auto wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+        uint64_t num_bytes_out = 0;
+        double busy_seconds = 0;
+        for (uint8_t thread = 0; thread < num_threads_; ++thread) {
+            num_bytes_out += thread_bytes_out_[thread];
+            busy_seconds += thread_seconds_[thread];
+            PLOG_VERBOSE << "Decompression thread " << +thread << " inflated " << thread_bytes_out_[thread] / 1000000.0
+                         << " MB in " << thread_seconds_[thread] << "s";
+        }
+        PLOG_INFO << "Decompressed " << path_.filename() << " (" << (is_bgzf_ ? "BGZF" : is_bzip2_ ? "bzip2" : "gzip") << ") from "
+                  << num_bytes_in_ / 1000000.0 << " MB to " << num_bytes_out / 1000000.0 << " MB with "
+                  << +num_threads_ << " thread(s): " << num_bytes_out / 1000000.0 / std::max(busy_seconds, 1e-9)
+                  << " MB/s per thread while inflating, " << num_bytes_out / 1000000.0 / std::max(wall_seconds, 1e-9)
+                  << " MB/s overall";
+    }
+};
+
+#endif // CHARON_DECOMPRESSED_INPUT_H
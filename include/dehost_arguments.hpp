@@ -11,15 +11,26 @@ struct DehostArguments {
     std::filesystem::path read_file;
     std::filesystem::path read_file2;
     bool is_paired{false};
-    std::string db;
+    std::vector<std::string> db;
+    std::string layout{"auto"};
+    bool sort_queries{false};
+    bool cascade{false};
+    bool prefilter{false};
+    uint32_t max_minimisers{0};
+    std::string subsample{"hash"};
 
     // Output options
     bool run_extract{false};
     std::string category_to_extract;
     std::string prefix;
+    uint8_t compression_level{6};
+    std::string output;
+    bool ordered{false};
     std::unordered_map<uint8_t, std::vector<std::filesystem::path>> extract_category_to_file;
 
-    uint8_t chunk_size{100};
+    uint32_t chunk_size{1000};
+    uint64_t batch_bases{1000000};
+    uint32_t split_length{100000};
 
     // Stats options
     float lo_hi_threshold{0.15};
@@ -29,17 +40,24 @@ struct DehostArguments {
     // thresholds for filtering
     float min_quality{15.0};
     uint32_t min_length{140};
+    std::string complexity{"estimate"};
     float min_compression{0};
     uint8_t confidence_threshold{7};
     float confidence_probability_threshold{0};
     float host_unique_prop_lo_threshold{0.05};
     float min_proportion_difference{0.04};
     float min_prob_difference{0};
+    uint8_t triage_confidence{0};
+    float prefilter_fraction{0.8};
+    uint16_t prefilter_min_hits{5};
+    uint32_t early_stop{0};
+    float early_stop_error{0.001};
 
 
     // General options
     std::string log_file{"charon.log"};
     uint8_t threads{1};
+    uint8_t decompression_threads{4};
     uint8_t verbosity{0};
 
     std::string to_string() {
@@ -48,28 +66,47 @@ struct DehostArguments {
         ss += "\n\nDehost Arguments:\n\n";
         ss += "\tread_file:\t\t\t" + read_file.string() + "\n";
         ss += "\tread_file2:\t\t\t" + read_file2.string() + "\n";
-        ss += "\tdb:\t\t\t\t" + db + "\n\n";
+        for (const auto &db_file: db)
+            ss += "\tdb:\t\t\t\t" + db_file + "\n";
+        ss += "\tlayout:\t\t\t\t" + layout + "\n";
+        ss += "\tcascade:\t\t\t" + std::to_string(cascade) + "\n";
+        ss += "\tprefilter:\t\t\t" + std::to_string(prefilter) + "\n";
+        ss += "\tsort_queries:\t\t\t" + std::to_string(sort_queries) + "\n";
+        ss += "\tmax_minimisers:\t\t\t" + std::to_string(max_minimisers) + "\n";
+        ss += "\tsubsample:\t\t\t" + subsample + "\n\n";
 
         ss += "\tcategory_to_extract:\t\t" + category_to_extract + "\n";
-        ss += "\tprefix:\t\t\t\t" + prefix + "\n\n";
-
-        ss += "\tchunk_size:\t\t\t" + std::to_string(chunk_size) + "\n\n";
+        ss += "\tprefix:\t\t\t\t" + prefix + "\n";
+        ss += "\tcompression_level:\t" + std::to_string(compression_level) + "\n";
+        ss += "\toutput:\t\t\t\t" + output + "\n";
+        ss += "\tordered:\t\t\t" + std::to_string(ordered) + "\n\n";
+
+        ss += "\tchunk_size:\t\t\t" + std::to_string(chunk_size) + "\n";
+        ss += "\tbatch_bases:\t\t\t" + std::to_string(batch_bases) + "\n";
+        ss += "\tsplit_length:\t\t\t" + std::to_string(split_length) + "\n\n";
         ss += "\tlo_hi_threshold:\t\t" + std::to_string(lo_hi_threshold) + "\n";
         ss += "\tnum_reads_to_fit:\t\t" + std::to_string(num_reads_to_fit) + "\n";
         ss += "\tdist:\t\t\t\t" + dist + "\n\n";
 
         ss += "\tmin_length:\t\t\t" + std::to_string(min_length) + "\n";
         ss += "\tmin_quality:\t\t\t" + std::to_string(min_quality) + "\n";
+        ss += "\tcomplexity:\t\t\t" + complexity + "\n";
         ss += "\tmin_compression:\t\t" + std::to_string(min_compression) + "\n";
         ss += "\tconfidence_threshold:\t\t" + std::to_string(confidence_threshold) + "\n";
         ss += "\tconfidence_probability_threshold:\t\t" + std::to_string(confidence_probability_threshold) + "\n";
         ss += "\thost_unique_prop_lo_threshold:\t" + std::to_string(host_unique_prop_lo_threshold) + "\n";
         ss += "\tmin_proportion_difference:\t" + std::to_string(min_proportion_difference) + "\n";
-        ss += "\tmin_prob_difference:\t\t" + std::to_string(min_prob_difference) + "\n\n";
+        ss += "\tmin_prob_difference:\t\t" + std::to_string(min_prob_difference) + "\n";
+        ss += "\ttriage_confidence:\t\t" + std::to_string(triage_confidence) + "\n";
+        ss += "\tprefilter_fraction:\t\t" + std::to_string(prefilter_fraction) + "\n";
+        ss += "\tprefilter_min_hits:\t\t" + std::to_string(prefilter_min_hits) + "\n";
+        ss += "\tearly_stop:\t\t\t" + std::to_string(early_stop) + "\n";
+        ss += "\tearly_stop_error:\t\t" + std::to_string(early_stop_error) + "\n\n";
 
 
         ss += "\tlog_file:\t\t\t" + log_file + "\n";
         ss += "\tthreads:\t\t\t" + std::to_string(threads) + "\n";
+        ss += "\tdecompression_threads:\t" + std::to_string(decompression_threads) + "\n";
         ss += "\tverbosity:\t\t\t" + std::to_string(verbosity) + "\n\n";
 
         return ss;
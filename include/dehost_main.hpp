@@ -12,13 +12,13 @@
 
 #include "result.hpp"
 
-class Index;
+class IndexSet;
 
 struct DehostArguments;
 
 void setup_dehost_subcommand(CLI::App &app);
 
-void dehost_reads(const DehostArguments &opt, const Index &index);
+void dehost_reads(const DehostArguments &opt, const IndexSet &index);
 
 int dehost_main(DehostArguments &opt);
 
@@ -0,0 +1,142 @@
+#ifndef CHARON_EXACT_INDEX_H
+#define CHARON_EXACT_INDEX_H
+
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cassert>
+#include <vector>
+
+#include <cereal/types/vector.hpp>
+#include <seqan3/core/concept/cereal.hpp>
+#include <plog/Log.h>
+
+#include "hashing.hpp"
+
+// Open addressing hash table mapping each distinct minimiser to a packed bitmask of the bins containing it. Unlike the
+// IBF there are no false positives, at the cost of storing every minimiser. Each slot holds the key followed by its
+// mask so a lookup usually reads a single cache line.
+class ExactIndex {
+private:
+    static constexpr uint64_t empty_key{~0ULL};
+    static constexpr double max_load_factor{0.7};
+
+    uint8_t num_bins_{0};
+    uint8_t num_words_{0}; // words per mask, one bit per bin
+    uint64_t capacity_{0}; // number of slots, a power of 2
+    uint64_t num_keys_{0};
+    std::vector<uint64_t> slots_{}; // capacity_ slots of 1 + num_words_ words
+    std::vector<uint64_t> empty_key_mask_{}; // mask for a minimiser equal to empty_key, which cannot be stored in a slot
+    std::vector<uint64_t> zero_mask_{};
+
+    inline uint64_t slot_width() const {
+        return 1u + num_words_;
+    }
+
+public:
+    ExactIndex() = default;
+
+    ExactIndex(ExactIndex const &) = default;
+
+    ExactIndex(ExactIndex &&) = default;
+
+    ExactIndex &operator=(ExactIndex const &) = default;
+
+    ExactIndex &operator=(ExactIndex &&) = default;
+
+    ~ExactIndex() = default;
+
+    // max_num_keys is an upper bound on the number of distinct minimisers which will be added
+    ExactIndex(const uint8_t num_bins, const uint64_t max_num_keys) :
+            num_bins_{num_bins},
+            num_words_(static_cast<uint8_t>((num_bins + 63) / 64)) {
+        assert(num_bins > 0);
+        capacity_ = std::bit_ceil(static_cast<uint64_t>(max_num_keys / max_load_factor) + 1);
+        slots_.resize(capacity_ * slot_width(), 0);
+        for (uint64_t slot = 0; slot < capacity_; ++slot)
+            slots_[slot * slot_width()] = empty_key;
+        empty_key_mask_.resize(num_words_, 0);
+        zero_mask_.resize(num_words_, 0);
+        PLOG_INFO << "Created exact index with " << capacity_ << " slots using " << size_in_bytes() / 1e9 << "GB";
+    }
+
+    uint8_t bin_count() const {
+        return num_bins_;
+    }
+
+    uint8_t num_words() const {
+        return num_words_;
+    }
+
+    uint64_t size() const {
+        return num_keys_;
+    }
+
+    uint64_t size_in_bytes() const {
+        return slots_.size() * sizeof(uint64_t);
+    }
+
+    inline uint64_t slot_index(const uint64_t value) const {
+        return mix64(value) & (capacity_ - 1);
+    }
+
+    // The slot at which probing for the value starts
+    inline const uint64_t *slot(const uint64_t value) const {
+        return slots_.data() + slot_index(value) * slot_width();
+    }
+
+    void emplace(const uint64_t value, const uint8_t bin) {
+        assert(bin < num_bins_);
+        const auto word = bin >> 6;
+        const auto bit = 1ULL << (bin & 63);
+        if (value == empty_key) {
+            empty_key_mask_[word] |= bit;
+            return;
+        }
+
+        auto slot = slot_index(value);
+        while (true) {
+            auto *entry = slots_.data() + slot * slot_width();
+            if (entry[0] == empty_key) {
+                assert(num_keys_ + 1 < capacity_);
+                entry[0] = value;
+                num_keys_ += 1;
+            }
+            if (entry[0] == value) {
+                entry[1 + word] |= bit;
+                return;
+            }
+            slot = (slot + 1) & (capacity_ - 1);
+        }
+    }
+
+    // Returns num_words() words with a 1 for each bin containing the value
+    inline const uint64_t *bulk_contains(const uint64_t value) const {
+        if (value == empty_key)
+            return empty_key_mask_.data();
+
+        auto slot = slot_index(value);
+        while (true) {
+            const auto *entry = slots_.data() + slot * slot_width();
+            if (entry[0] == value)
+                return entry + 1;
+            if (entry[0] == empty_key)
+                return zero_mask_.data();
+            slot = (slot + 1) & (capacity_ - 1);
+        }
+    }
+
+    template<seqan3::cereal_archive archive_t>
+    void CEREAL_SERIALIZE_FUNCTION_NAME(archive_t &archive) {
+        archive(num_bins_);
+        archive(num_words_);
+        archive(capacity_);
+        archive(num_keys_);
+        archive(slots_);
+        archive(empty_key_mask_);
+        archive(zero_mask_);
+    }
+};
+
+#endif // CHARON_EXACT_INDEX_H
@@ -0,0 +1,58 @@
+#ifndef CHARON_EXTRACT_ARGUMENTS_H
+#define CHARON_EXTRACT_ARGUMENTS_H
+
+#pragma once
+
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/// Collection of all options of extract subcommand.
+struct ExtractArguments {
+    // IO options
+    std::filesystem::path read_file;
+    std::filesystem::path read_file2;
+    bool is_paired{false};
+    std::filesystem::path assignments;
+    std::vector<std::string> categories;
+    uint32_t chunk_size{1000};
+    uint64_t batch_bases{1000000};
+
+    // Output options
+    std::string prefix;
+    uint8_t compression_level{6};
+    bool ids_only{false};
+
+    // General options
+    std::string log_file{"charon.log"};
+    uint8_t threads{1};
+    uint8_t decompression_threads{4};
+    uint8_t verbosity{0};
+
+    std::string to_string() {
+        std::string ss;
+
+        ss += "\n\nExtract Arguments:\n\n";
+        ss += "\tread_file:\t\t" + read_file.string() + "\n";
+        ss += "\tread_file2:\t\t" + read_file2.string() + "\n";
+        ss += "\tassignments:\t\t" + assignments.string() + "\n";
+        for (const auto &category: categories)
+            ss += "\tcategory:\t\t" + category + "\n";
+        ss += "\tchunk_size:\t\t" + std::to_string(chunk_size) + "\n";
+        ss += "\tbatch_bases:\t\t" + std::to_string(batch_bases) + "\n\n";
+
+        ss += "\tprefix:\t\t\t" + prefix + "\n";
+        ss += "\tcompression_level:\t" + std::to_string(compression_level) + "\n";
+        ss += "\tids_only:\t\t" + std::to_string(ids_only) + "\n\n";
+
+        ss += "\tlog_file:\t\t" + log_file + "\n";
+        ss += "\tthreads:\t\t" + std::to_string(threads) + "\n";
+        ss += "\tdecompression_threads:\t" + std::to_string(decompression_threads) + "\n";
+        ss += "\tverbosity:\t\t" + std::to_string(verbosity) + "\n\n";
+
+        return ss;
+    }
+};
+
+#endif // CHARON_EXTRACT_ARGUMENTS_H
@@ -0,0 +1,24 @@
+#ifndef CHARON_EXTRACT_MAIN_H
+#define CHARON_EXTRACT_MAIN_H
+
+#pragma once
+
+#include <omp.h>
+#include <cstring>
+
+#include "CLI11.hpp"
+
+#include "assignment_table.hpp"
+
+struct ExtractArguments;
+
+void setup_extract_subcommand(CLI::App &app);
+
+void extract_reads(const ExtractArguments &opt, const AssignmentTable &table);
+
+void extract_paired_reads(const ExtractArguments &opt, const AssignmentTable &table);
+
+int extract_main(ExtractArguments &opt);
+
+
+#endif // CHARON_EXTRACT_MAIN_H
@@ -0,0 +1,307 @@
+#ifndef CHARON_EXTRACT_WRITER_H
+#define CHARON_EXTRACT_WRITER_H
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <omp.h>
+#include <plog/Log.h>
+
+#include "read_pipeline.hpp"
+
+// Writes extracted reads to their files as BGZF, i.e. multi-member gzip which any gzip reader can read and whose
+// blocks can be decompressed in parallel.
+//
+// Reads are added to an output, which is one file, or two files for the mates of paired reads (e.g. one output per
+// category extracted). Each worker thread formats reads into its own buffer per file. Once a buffer holds block_size
+// bytes, the thread's buffers for all files of the output are handed off together, so that mates are written in the
+// same order to both files. The blocks are compressed by a pool of threads shared by all outputs. Each file has its
+// own queue and appender thread, which writes its blocks in the order they were handed off, so outputs only share the
+// compression threads and do not hold each other back. With compression_level 0 the blocks are written uncompressed.
+// At most 2 * threads + 2 blocks wait to be written per file, and workers wait rather than exceed it.
+class ExtractWriter {
+private:
+    static constexpr size_t block_size{1 << 18};
+    static constexpr size_t max_bgzf_input{0xff00}; // uncompressed bytes per BGZF block, as written by bgzip
+    static constexpr uint8_t bgzf_header_size{18};
+    static constexpr uint8_t bgzf_footer_size{8};
+    static constexpr std::array<uint8_t, 28> bgzf_eof{0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff,
+                                                      0x06, 0x00, 0x42, 0x43, 0x02, 0x00, 0x1b, 0x00, 0x03, 0x00,
+                                                      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+    struct Block {
+        std::string text;
+        std::string compressed;
+        std::promise<void> done;
+        std::future<void> ready{done.get_future()};
+    };
+
+    struct alignas(64) ThreadBuffers {
+        std::vector<std::string> texts; // one per file
+    };
+
+    struct OutputFile {
+        std::string path;
+        int fd{-1};
+        BoundedQueue<std::shared_ptr<Block>> in_order; // blocks in the order they are written
+        std::thread appender;
+        uint64_t num_bytes_in{0};
+        uint64_t num_bytes_written{0};
+
+        OutputFile(const std::string &path, const int fd, const size_t max_blocks) :
+                path(path),
+                fd(fd),
+                in_order(max_blocks) {}
+    };
+
+    struct Output {
+        std::vector<size_t> files;
+        std::mutex hand_off_mutex; // keeps the mates handed off together in the same order in both files
+    };
+
+    int compression_level_{6};
+    uint8_t threads_{1};
+    std::vector<std::unique_ptr<OutputFile>> files_{};
+    std::vector<std::unique_ptr<Output>> outputs_{};
+    std::vector<ThreadBuffers> thread_buffers_{};
+
+    BoundedQueue<std::shared_ptr<Block>> to_compress_;
+    std::vector<std::thread> compressors_{};
+    bool started_{false};
+
+    std::vector<double> compress_seconds_{};
+
+    static void write_all(OutputFile &file, const char *data, const size_t size) {
+        size_t offset = 0;
+        while (offset < size) {
+            const auto written = ::write(file.fd, data + offset, size - offset);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                PLOG_ERROR << "Failed to write extracted reads to " << file.path << ": " << std::strerror(errno);
+                exit(1);
+            }
+            offset += written;
+        }
+        file.num_bytes_written += size;
+    }
+
+    // Appends text to out as BGZF blocks
+    static void compress_bgzf(z_stream &stream, const std::string &text, std::string &out) {
+        for (size_t offset = 0; offset < text.size(); offset += max_bgzf_input) {
+            const auto size = std::min(max_bgzf_input, text.size() - offset);
+            const auto *input = reinterpret_cast<const Bytef *>(text.data() + offset);
+            deflateReset(&stream);
+            const auto first = out.size();
+            out.resize(first + bgzf_header_size + deflateBound(&stream, size) + bgzf_footer_size);
+            auto *block = reinterpret_cast<uint8_t *>(out.data() + first);
+
+            stream.next_in = input;
+            stream.avail_in = size;
+            stream.next_out = block + bgzf_header_size;
+            stream.avail_out = out.size() - first - bgzf_header_size - bgzf_footer_size;
+            if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+                PLOG_ERROR << "Failed to compress extracted reads";
+                exit(1);
+            }
+
+            const uint32_t block_length = bgzf_header_size + stream.total_out + bgzf_footer_size;
+            std::copy(bgzf_eof.begin(), bgzf_eof.begin() + 16, block);
+            block[16] = (block_length - 1) & 0xff;
+            block[17] = (block_length - 1) >> 8;
+            const uint32_t crc = crc32(crc32(0L, Z_NULL, 0), input, size);
+            auto *footer = block + bgzf_header_size + stream.total_out;
+            for (uint8_t i = 0; i < 4; ++i) {
+                footer[i] = crc >> (8 * i);
+                footer[4 + i] = size >> (8 * i);
+            }
+            out.resize(first + block_length);
+        }
+    }
+
+    void compress(const uint8_t thread) {
+        z_stream stream{};
+        if (deflateInit2(&stream, compression_level_, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            PLOG_ERROR << "Could not initialise zlib";
+            exit(1);
+        }
+        std::shared_ptr<Block> block;
+        while (to_compress_.pop(block)) {
+            const auto start = std::chrono::steady_clock::now();
+            compress_bgzf(stream, block->text, block->compressed);
+            block->text = std::string();
+            compress_seconds_[thread] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            block->done.set_value();
+            block.reset();
+        }
+        deflateEnd(&stream);
+    }
+
+    void append(OutputFile &file) {
+        std::shared_ptr<Block> block;
+        while (file.in_order.pop(block)) {
+            block->ready.wait();
+            if (compression_level_ > 0)
+                write_all(file, block->compressed.data(), block->compressed.size());
+            else
+                write_all(file, block->text.data(), block->text.size());
+            block.reset();
+        }
+    }
+
+    // Queues the non-empty buffers for the files of output, which must be those of the calling thread or of a thread
+    // which has finished
+    void hand_off(ThreadBuffers &buffers, Output &output) {
+        std::unique_lock lock(output.hand_off_mutex);
+        for (const auto file_index: output.files) {
+            auto &text = buffers.texts[file_index];
+            if (text.empty())
+                continue;
+            auto &file = *files_[file_index];
+            auto block = std::make_shared<Block>();
+            block->text.swap(text);
+            text.reserve(block_size + (1 << 12));
+            file.num_bytes_in += block->text.size();
+            if (compression_level_ > 0) {
+                file.in_order.push(std::shared_ptr<Block>(block));
+                to_compress_.push(std::move(block));
+            } else {
+                block->done.set_value();
+                file.in_order.push(std::move(block));
+            }
+        }
+    }
+
+    // Copies the record as it was read, so headers, case and line breaks are kept as in the input
+    template<typename record_t>
+    static void append_record(const record_t &record, std::string &text) {
+        text += record.raw();
+    }
+
+public:
+    // compression_level is that of zlib (1-9), or 0 to write uncompressed. threads is both the number of worker
+    // threads adding reads and of compression threads.
+    ExtractWriter(const int compression_level, const uint8_t threads) :
+            compression_level_(compression_level),
+            threads_(std::max<uint8_t>(threads, 1)),
+            thread_buffers_(threads_),
+            to_compress_(2 * threads_),
+            compress_seconds_(threads_, 0) {}
+
+    ExtractWriter(ExtractWriter const &) = delete;
+
+    ExtractWriter &operator=(ExtractWriter const &) = delete;
+
+    ~ExtractWriter() {
+        close();
+    }
+
+    // Opens the files of an output, one or two for paired reads, and returns the index to add reads to it with. All
+    // outputs must be added before start.
+    size_t add_output(const std::vector<std::string> &paths) {
+        auto output = std::make_unique<Output>();
+        for (const auto &path: paths) {
+            const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) {
+                PLOG_ERROR << "Could not open " << path << " for writing: " << std::strerror(errno);
+                exit(1);
+            }
+            output->files.push_back(files_.size());
+            files_.push_back(std::make_unique<OutputFile>(path, fd, 2 * threads_ + 2));
+        }
+        for (auto &buffers: thread_buffers_)
+            buffers.texts.resize(files_.size());
+        outputs_.push_back(std::move(output));
+        return outputs_.size() - 1;
+    }
+
+    // Starts the appender thread of each file and the compression threads
+    void start() {
+        for (auto &file: files_)
+            file->appender = std::thread(&ExtractWriter::append, this, std::ref(*file));
+        if (compression_level_ > 0) {
+            for (uint8_t thread = 0; thread < threads_; ++thread)
+                compressors_.emplace_back(&ExtractWriter::compress, this, thread);
+        }
+        started_ = true;
+    }
+
+    template<typename record_t>
+    void add(const size_t output_index, const record_t &record) {
+        auto &output = *outputs_[output_index];
+        auto &buffers = thread_buffers_.at(omp_get_thread_num());
+        auto &text = buffers.texts[output.files[0]];
+        append_record(record, text);
+        if (text.size() >= block_size)
+            hand_off(buffers, output);
+    }
+
+    // Adds the mates of a paired read to the two files of the output
+    template<typename record_t>
+    void add_pair(const size_t output_index, const record_t &record1, const record_t &record2) {
+        auto &output = *outputs_[output_index];
+        auto &buffers = thread_buffers_.at(omp_get_thread_num());
+        auto &text1 = buffers.texts[output.files[0]];
+        auto &text2 = buffers.texts[output.files[1]];
+        append_record(record1, text1);
+        append_record(record2, text2);
+        if (text1.size() >= block_size or text2.size() >= block_size)
+            hand_off(buffers, output);
+    }
+
+    // Writes everything left, ends the files and stops the threads
+    void close() {
+        if (not started_)
+            return;
+        started_ = false;
+        for (auto &buffers: thread_buffers_) {
+            for (auto &output: outputs_)
+                hand_off(buffers, *output);
+        }
+        to_compress_.close();
+        for (auto &file: files_)
+            file->in_order.close();
+        for (auto &thread: compressors_)
+            thread.join();
+        compressors_.clear();
+
+        uint64_t num_bytes_in = 0;
+        uint64_t num_bytes_out = 0;
+        for (auto &file: files_) {
+            file->appender.join();
+            if (compression_level_ > 0)
+                write_all(*file, reinterpret_cast<const char *>(bgzf_eof.data()), bgzf_eof.size());
+            ::close(file->fd);
+            PLOG_VERBOSE << "Wrote " << file->num_bytes_written / 1000000.0 << " MB to " << file->path;
+            num_bytes_in += file->num_bytes_in;
+            num_bytes_out += file->num_bytes_written;
+        }
+        double seconds = 0;
+        for (const auto &thread_seconds: compress_seconds_)
+            seconds += thread_seconds;
+
+        PLOG_INFO << "Wrote " << num_bytes_out / 1000000.0 << " MB of extracted reads (" << num_bytes_in / 1000000.0
+                  << " MB uncompressed) to " << files_.size() << " file(s)";
+        if (compression_level_ > 0)
+            PLOG_INFO << "Compressing at level " << compression_level_ << " took " << seconds << "s of thread time, "
+                      << num_bytes_in / 1000000.0 / std::max(seconds, 1e-9) << " MB/s per thread";
+    }
+};
+
+#endif // CHARON_EXTRACT_WRITER_H
@@ -0,0 +1,211 @@
+#ifndef CHARON_FASTX_READER_H
+#define CHARON_FASTX_READER_H
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <iterator>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <seqan3/alphabet/nucleotide/dna5.hpp>
+#include <seqan3/alphabet/quality/phred94.hpp>
+
+// A FASTA or FASTQ record which keeps the bytes it was read from, so that it can be written out again unchanged
+class FastxRecord {
+private:
+    friend class FastxReader;
+
+    std::string raw_{}; // the record as in the input, always ending with a newline
+    std::string id_{};
+    std::vector<seqan3::dna5> sequence_{};
+    size_t quality_offset_{0}; // of the qualities in raw_, none for FASTA
+    size_t quality_length_{0};
+
+    void clear() {
+        raw_.clear();
+        id_.clear();
+        sequence_.clear();
+        quality_offset_ = 0;
+        quality_length_ = 0;
+    }
+
+public:
+    FastxRecord() = default;
+
+    FastxRecord(FastxRecord const &) = default;
+
+    FastxRecord(FastxRecord &&) = default;
+
+    FastxRecord &operator=(FastxRecord const &) = default;
+
+    FastxRecord &operator=(FastxRecord &&) = default;
+
+    ~FastxRecord() = default;
+
+    // The whole header line after the '@' or '>', as seqan3 reads it
+    const std::string &id() const {
+        return id_;
+    }
+
+    const std::vector<seqan3::dna5> &sequence() const {
+        return sequence_;
+    }
+
+    // The qualities decoded from the bytes of the record as they are used, rather than stored separately
+    auto base_qualities() const {
+        return std::string_view(raw_).substr(quality_offset_, quality_length_) |
+               std::views::transform([](const char quality) { return seqan3::phred94{}.assign_char(quality); });
+    }
+
+    std::string_view raw() const {
+        return raw_;
+    }
+};
+
+// Reads FASTA (including multi-line sequences) and FASTQ records from an uncompressed stream, as an input range like
+// seqan3::sequence_file_input: begin() points to the record read last, and incrementing reads the next one into it.
+// Malformed input throws std::runtime_error.
+class FastxReader {
+public:
+    using record_type = FastxRecord;
+
+    class iterator {
+    private:
+        FastxReader *reader_{nullptr};
+
+    public:
+        using iterator_concept = std::input_iterator_tag;
+        using iterator_category = std::input_iterator_tag;
+        using value_type = FastxRecord;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+
+        explicit iterator(FastxReader &reader) :
+                reader_(&reader) {}
+
+        FastxRecord &operator*() const {
+            return reader_->record_;
+        }
+
+        iterator &operator++() {
+            reader_->read_next();
+            return *this;
+        }
+
+        void operator++(int) {
+            ++*this;
+        }
+
+        bool at_end() const {
+            return reader_->at_end_;
+        }
+
+        friend bool operator==(const iterator &it, std::default_sentinel_t) {
+            return it.at_end();
+        }
+    };
+
+private:
+    std::istream *stream_{nullptr};
+    FastxRecord record_{};
+    std::string line_{};
+    uint64_t line_number_{0};
+    bool started_{false};
+    bool at_end_{false};
+
+    bool read_line() {
+        if (not std::getline(*stream_, line_))
+            return false;
+        ++line_number_;
+        return true;
+    }
+
+    // The line without a trailing carriage return
+    std::string_view content() const {
+        std::string_view line(line_);
+        if (not line.empty() and line.back() == '\r')
+            line.remove_suffix(1);
+        return line;
+    }
+
+    [[noreturn]] void fail(const std::string &message) const {
+        throw std::runtime_error(message + " at line " + std::to_string(line_number_) + " of the reads");
+    }
+
+    void append_line() {
+        record_.raw_ += line_;
+        record_.raw_ += '\n';
+    }
+
+    void append_sequence(const std::string_view line) {
+        for (const char base: line)
+            record_.sequence_.push_back(seqan3::dna5{}.assign_char(base));
+    }
+
+    void read_next() {
+        record_.clear();
+        do {
+            if (not read_line()) {
+                at_end_ = true;
+                return;
+            }
+        } while (content().empty());
+
+        const char marker = line_.front();
+        if (marker != '@' and marker != '>')
+            fail("Expected a FASTA or FASTQ record");
+        record_.id_ = content().substr(1);
+        append_line();
+
+        if (marker == '>') {
+            while (stream_->peek() != '>' and stream_->peek() != std::char_traits<char>::eof() and read_line()) {
+                append_line();
+                append_sequence(content());
+            }
+            return;
+        }
+
+        if (not read_line())
+            fail("Missing sequence");
+        append_line();
+        append_sequence(content());
+        if (not read_line() or line_.empty() or line_.front() != '+')
+            fail("Expected a '+' line");
+        append_line();
+        if (not read_line())
+            fail("Missing qualities");
+        record_.quality_offset_ = record_.raw_.size();
+        record_.quality_length_ = content().size();
+        append_line();
+        if (record_.quality_length_ != record_.sequence_.size())
+            fail("Sequence and qualities differ in length");
+    }
+
+public:
+    explicit FastxReader(std::istream &stream) :
+            stream_(&stream) {}
+
+    FastxReader(FastxReader const &) = delete;
+
+    FastxReader &operator=(FastxReader const &) = delete;
+
+    iterator begin() {
+        if (not started_) {
+            started_ = true;
+            read_next();
+        }
+        return iterator(*this);
+    }
+
+    std::default_sentinel_t end() const {
+        return std::default_sentinel;
+    }
+};
+
+#endif // CHARON_FASTX_READER_H
@@ -0,0 +1,32 @@
+#ifndef CHARON_HASHING_H
+#define CHARON_HASHING_H
+
+#pragma once
+
+#include <cstdint>
+
+// murmur3 finaliser, used to spread minimiser values before placing them in our own tables
+static inline uint64_t mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// maps h uniformly onto [0, range) without a division
+static inline uint64_t fit64(const uint64_t h, const uint64_t range) {
+#ifdef __SIZEOF_INT128__
+    return static_cast<uint64_t>((static_cast<__uint128_t>(h) * static_cast<__uint128_t>(range)) >> 64);
+#else
+    return h % range;
+#endif
+}
+
+// deterministic 1 in rate subsample of minimisers, independent of how the minimiser values are distributed
+static inline bool in_subsample(const uint64_t value, const uint16_t rate) {
+    return rate <= 1 or mix64(value ^ 0x2545F4914F6CDD1DULL) % rate == 0;
+}
+
+#endif // CHARON_HASHING_H
@@ -0,0 +1,24 @@
+#ifndef CHARON_HIT_KERNELS_H
+#define CHARON_HIT_KERNELS_H
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "hit_matrix.hpp"
+
+// Kernels summarising the hit matrix of a read. Each has a scalar version and, on x86-64, AVX2 and AVX-512 versions
+// chosen at runtime according to what the CPU supports.
+
+// Adds the number of rows with a hit in each bin to totals, which must hold hits.num_words * 64 counts
+void count_bin_hits(const HitMatrixView &hits, uint32_t *totals);
+
+// For each row with a hit in the bin of exactly one category, adds one to unique_counts for that category
+void count_unique_category_hits(const HitMatrixView &hits, const uint8_t *category_bins, const uint8_t num_categories,
+                                uint32_t *unique_counts);
+
+// The instruction set used by the kernels, for the log
+std::string hit_kernel_name();
+
+#endif // CHARON_HIT_KERNELS_H
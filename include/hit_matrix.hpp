@@ -0,0 +1,99 @@
+#ifndef CHARON_HIT_MATRIX_H
+#define CHARON_HIT_MATRIX_H
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+// Read-only view of a HitMatrix: num_rows rows of num_words words, one row per minimiser and one bit per bin.
+struct HitMatrixView {
+    const uint64_t *data{nullptr};
+    uint32_t num_rows{0};
+    uint16_t num_words{0};
+
+    inline const uint64_t *row(const uint32_t i) const {
+        assert(i < num_rows);
+        return data + static_cast<size_t>(i) * num_words;
+    }
+};
+
+// Packed minimisers x bins bit matrix holding the index hits of one read. Each thread keeps one and resets it between
+// reads, so the storage grows to the longest read seen and is then reused without further allocation.
+class HitMatrix {
+private:
+    std::vector<uint64_t> data_{};
+    uint32_t num_rows_{0};
+    uint16_t num_words_{0};
+
+public:
+    HitMatrix() = default;
+
+    HitMatrix(HitMatrix const &) = default;
+
+    HitMatrix(HitMatrix &&) = default;
+
+    HitMatrix &operator=(HitMatrix const &) = default;
+
+    HitMatrix &operator=(HitMatrix &&) = default;
+
+    ~HitMatrix() = default;
+
+    // Empty the matrix for a read with rows of num_words words, keeping the allocated storage
+    void reset(const uint16_t num_words, const size_t expected_rows = 0) {
+        num_words_ = num_words;
+        num_rows_ = 0;
+        if (data_.size() < expected_rows * num_words)
+            data_.resize(expected_rows * num_words);
+    }
+
+    uint32_t num_rows() const {
+        return num_rows_;
+    }
+
+    uint16_t num_words() const {
+        return num_words_;
+    }
+
+    // Empty the matrix and make room for num_rows rows to be filled in any order with row()
+    void resize(const uint16_t num_words, const uint32_t num_rows) {
+        num_words_ = num_words;
+        num_rows_ = num_rows;
+        if (data_.size() < static_cast<size_t>(num_rows) * num_words)
+            data_.resize(static_cast<size_t>(num_rows) * num_words);
+    }
+
+    inline uint64_t *row(const uint32_t i) {
+        assert(i < num_rows_);
+        return data_.data() + static_cast<size_t>(i) * num_words_;
+    }
+
+    // Returns a row to be filled by the caller
+    inline uint64_t *append_row() {
+        const auto end = static_cast<size_t>(num_rows_ + 1) * num_words_;
+        if (data_.size() < end)
+            data_.resize(std::max(end, 2 * data_.size()));
+        num_rows_ += 1;
+        return data_.data() + end - num_words_;
+    }
+
+    inline void append(const uint64_t *entry) {
+        auto *row = append_row();
+        for (auto word = 0; word < num_words_; ++word)
+            row[word] = entry[word];
+    }
+
+    HitMatrixView view() const {
+        return HitMatrixView{data_.data(), num_rows_, num_words_};
+    }
+
+    // View of the num_rows rows starting at row first
+    HitMatrixView view(const uint32_t first, const uint32_t num_rows) const {
+        assert(first + num_rows <= num_rows_);
+        return HitMatrixView{data_.data() + static_cast<size_t>(first) * num_words_, num_rows, num_words_};
+    }
+};
+
+#endif // CHARON_HIT_MATRIX_H
@@ -5,13 +5,17 @@
 
 #include <unordered_map>
 #include <string>
+#include <algorithm>
 
 #include <cereal/types/string.hpp>
 #include <cereal/types/unordered_map.hpp>
+#include <cereal/archives/binary.hpp>
 #include <seqan3/search/dream_index/interleaved_bloom_filter.hpp>
 #include <plog/Log.h>
 
 #include <index_main.hpp>
+#include <index_agent.hpp>
+#include <hashing.hpp>
 #include <input_summary.hpp>
 #include <input_stats.hpp>
 
@@ -23,10 +27,18 @@ private:
     double max_fpr_{};
     InputSummary summary_{};
     InputStats stats_{};
+    IndexLayout layout_{IndexLayout::compressed};
     seqan3::interleaved_bloom_filter<seqan3::data_layout::compressed> ibf_{};
+    seqan3::interleaved_bloom_filter<seqan3::data_layout::uncompressed> uncompressed_ibf_{}; // only filled by decompress()
+    BlockedBloomFilter blocked_{}; // replaces the IBF when the index is built with --blocked
+    ExactIndex exact_{}; // replaces the IBF when the index is built with --exact
+    uint16_t triage_rate_{0}; // the triage IBF holds 1 in triage_rate_ minimisers, 0 if there is no triage IBF
+    seqan3::interleaved_bloom_filter<seqan3::data_layout::uncompressed> triage_ibf_{};
+    uint16_t prefilter_rate_{0}; // the prefilter holds 1 in prefilter_rate_ host-unique minimisers, 0 if there is none
+    SingleBinBlockedBloomFilter prefilter_{};
 
 public:
-    static constexpr uint32_t version{3u};
+    static constexpr uint32_t version{7u};
 
     Index() = default;
 
@@ -49,6 +61,26 @@ public:
             stats_{stats},
             ibf_(ibf) {}
 
+    Index(const IndexArguments &arguments, const InputSummary &summary, const InputStats &stats,
+          BlockedBloomFilter &&blocked) :
+            window_size_{arguments.window_size},
+            kmer_size_{arguments.kmer_size},
+            max_fpr_{arguments.max_fpr},
+            summary_{summary},
+            stats_{stats},
+            layout_{IndexLayout::blocked},
+            blocked_(std::move(blocked)) {}
+
+    Index(const IndexArguments &arguments, const InputSummary &summary, const InputStats &stats,
+          ExactIndex &&exact) :
+            window_size_{arguments.window_size},
+            kmer_size_{arguments.kmer_size},
+            max_fpr_{0},
+            summary_{summary},
+            stats_{stats},
+            layout_{IndexLayout::exact},
+            exact_(std::move(exact)) {}
+
     uint8_t window_size() const {
         return window_size_;
     }
@@ -107,8 +139,98 @@ public:
         return ibf_;
     }
 
-    seqan3::interleaved_bloom_filter<seqan3::data_layout::compressed>::membership_agent_type agent() const {
-        return ibf_.membership_agent();
+    IndexLayout layout() const {
+        return layout_;
+    }
+
+    uint64_t uncompressed_size_in_bytes() const {
+        if (layout_ == IndexLayout::blocked)
+            return blocked_.size_in_bytes();
+        else if (layout_ == IndexLayout::exact)
+            return exact_.size_in_bytes();
+        else if (layout_ == IndexLayout::uncompressed)
+            return uncompressed_ibf_.bit_size() / 8;
+        return ibf_.bit_size() / 8;
+    }
+
+    // Replace the compressed IBF with an uncompressed copy with identical bins, bin size and hash functions, so that
+    // queries are answered by plain word reads. Both copies are held in memory while converting.
+    void decompress(const uint8_t threads) {
+        if (layout_ != IndexLayout::compressed)
+            return;
+
+        PLOG_INFO << "Converting IBF to uncompressed layout";
+        seqan3::interleaved_bloom_filter<seqan3::data_layout::uncompressed> ibf{
+                seqan3::bin_count{ibf_.bin_count()},
+                seqan3::bin_size{ibf_.bin_size()},
+                seqan3::hash_function_count{ibf_.hash_function_count()}};
+
+        const auto &source = ibf_.raw_data();
+        auto &target = ibf.raw_data();
+        assert(source.size() == target.size());
+        const int64_t num_words = (source.size() + 63) / 64;
+
+#pragma omp parallel for num_threads(threads)
+        for (int64_t word = 0; word < num_words; ++word) {
+            const uint64_t position = word * 64;
+            const uint8_t length = std::min<uint64_t>(64, source.size() - position);
+            target.set_int(position, source.get_int(position, length), length);
+        }
+
+        uncompressed_ibf_ = std::move(ibf);
+        ibf_ = seqan3::interleaved_bloom_filter<seqan3::data_layout::compressed>{};
+        layout_ = IndexLayout::uncompressed;
+        PLOG_INFO << "IBF converted";
+    }
+
+    bool has_triage() const {
+        return triage_rate_ > 0;
+    }
+
+    uint16_t triage_rate() const {
+        return triage_rate_;
+    }
+
+    bool in_triage_sample(const uint64_t value) const {
+        return in_subsample(value, triage_rate_);
+    }
+
+    void set_triage(const uint16_t rate, seqan3::interleaved_bloom_filter<seqan3::data_layout::uncompressed> &&ibf) {
+        triage_rate_ = rate;
+        triage_ibf_ = std::move(ibf);
+    }
+
+    IndexAgent triage_agent() const {
+        assert(has_triage());
+        return IndexAgent(triage_ibf_);
+    }
+
+    bool has_prefilter() const {
+        return prefilter_rate_ > 0;
+    }
+
+    bool in_prefilter_sample(const uint64_t value) const {
+        return in_subsample(value, prefilter_rate_);
+    }
+
+    // True if the value may be a host-unique minimiser, a single cache line read
+    bool prefilter_contains(const uint64_t value) const {
+        return prefilter_.contains(value);
+    }
+
+    void set_prefilter(const uint16_t rate, SingleBinBlockedBloomFilter &&prefilter) {
+        prefilter_rate_ = rate;
+        prefilter_ = std::move(prefilter);
+    }
+
+    IndexAgent agent() const {
+        if (layout_ == IndexLayout::uncompressed)
+            return IndexAgent(uncompressed_ibf_);
+        else if (layout_ == IndexLayout::blocked)
+            return IndexAgent(blocked_);
+        else if (layout_ == IndexLayout::exact)
+            return IndexAgent(exact_);
+        return IndexAgent(ibf_);
     }
 
     /*!\cond DEV
@@ -134,7 +256,7 @@ public:
             PLOG_ERROR << "Cannot read index: " + std::string{e.what()};
             exit(1);
         }
-
+        serialize_extensions(archive);
     }
 
     /* \brief Serialisation support function. Do not load the actual data.
@@ -159,6 +281,49 @@ public:
             PLOG_ERROR << "Cannot read index: " + std::string{e.what()};
             exit(1);
         }
+        serialize_extensions(archive);
+    }
+
+    /* \brief Serialisation of everything following the IBF.
+     * \details Indexes up to version 3 end after the IBF, so running out of input when reading the version means
+     * the file holds a compressed IBF and nothing else.
+     */
+    template<seqan3::cereal_archive archive_t>
+    void serialize_extensions(archive_t &archive) {
+        uint32_t file_version{version};
+        if constexpr (seqan3::cereal_input_archive<archive_t>) {
+            try {
+                archive(file_version);
+            }
+            catch (cereal::Exception const &) {
+                layout_ = IndexLayout::compressed;
+                return;
+            }
+        } else {
+            archive(file_version);
+        }
+
+        try {
+            auto layout = static_cast<uint8_t>(layout_);
+            archive(layout);
+            layout_ = static_cast<IndexLayout>(layout);
+            archive(blocked_);
+            if (file_version >= 5)
+                archive(exact_);
+            if (file_version >= 6) {
+                archive(triage_rate_);
+                archive(triage_ibf_);
+            }
+            if (file_version >= 7) {
+                archive(prefilter_rate_);
+                archive(prefilter_);
+            }
+        }
+            // GCOVR_EXCL_START
+        catch (std::exception const &e) {
+            PLOG_ERROR << "Cannot read index: " + std::string{e.what()};
+            exit(1);
+        }
     }
     //!\endcond
 };
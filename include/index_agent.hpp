@@ -0,0 +1,258 @@
+#ifndef CHARON_INDEX_AGENT_H
+#define CHARON_INDEX_AGENT_H
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <seqan3/search/dream_index/interleaved_bloom_filter.hpp>
+#include <plog/Log.h>
+
+#include "blocked_bloom_filter.hpp"
+#include "exact_index.hpp"
+#include "hashing.hpp"
+#include "hit_matrix.hpp"
+
+// The in-memory layout of the index. The compressed IBF is what is stored on disk by default, the uncompressed IBF
+// needs more memory but answers each query with plain word reads. The blocked and exact layouts are chosen when the
+// index is built: blocked answers each query from a single cache line, exact has no false positives.
+enum class IndexLayout : uint8_t {
+    compressed,
+    uncompressed,
+    blocked,
+    exact
+};
+
+inline std::string layout_name(const IndexLayout layout) {
+    switch (layout) {
+        case IndexLayout::compressed:
+            return "compressed";
+        case IndexLayout::uncompressed:
+            return "uncompressed";
+        case IndexLayout::blocked:
+            return "blocked";
+        case IndexLayout::exact:
+            return "exact";
+    }
+    return "";
+}
+
+// Direct view of the words of an uncompressed IBF, replicating the hashing of seqan3::interleaved_bloom_filter so that
+// the word addresses for many values can be computed (and prefetched) before any of them are read. IndexAgent checks
+// this against the seqan3 membership agent before using it.
+class UncompressedIBFView {
+private:
+    static constexpr std::array<uint64_t, 5> hash_seeds{13572355802537770549ULL, 13043817825332782213ULL,
+                                                        10650232656628343401ULL, 16499269484942379435ULL,
+                                                        4893150838803335377ULL};
+
+    const uint64_t *data_{nullptr};
+    uint64_t bin_size_{0};
+    uint64_t hash_shift_{0};
+    uint64_t bin_words_{0};
+    uint8_t num_hash_{0};
+
+public:
+    UncompressedIBFView() = default;
+
+    explicit UncompressedIBFView(const seqan3::interleaved_bloom_filter<seqan3::data_layout::uncompressed> &ibf) :
+            data_{ibf.raw_data().data()},
+            bin_size_{ibf.bin_size()},
+            hash_shift_(std::countl_zero(ibf.bin_size())),
+            bin_words_{(ibf.bin_count() + 63) / 64},
+            num_hash_(static_cast<uint8_t>(ibf.hash_function_count())) {
+        assert(num_hash_ <= hash_seeds.size());
+    }
+
+    uint8_t num_hash() const {
+        return num_hash_;
+    }
+
+    uint64_t num_words() const {
+        return bin_words_;
+    }
+
+    // The first of bin_words_ words holding the bits of the value for hash function i
+    inline const uint64_t *row(const uint64_t value, const uint8_t i) const {
+        uint64_t h = value * hash_seeds[i];
+        h ^= h >> hash_shift_;
+        h *= 11400714819323198485ULL;
+        h = static_cast<uint64_t>((static_cast<__uint128_t>(h) * static_cast<__uint128_t>(bin_size_)) >> 64);
+        return data_ + h * bin_words_;
+    }
+
+    // The row of the first hash function, which orders values by where their lookup starts in memory
+    inline uint64_t position(const uint64_t value) const {
+        return (row(value, 0) - data_) / bin_words_;
+    }
+
+    inline void contains(const std::array<const uint64_t *, 5> &rows, uint64_t *result) const {
+        for (auto word = 0; word < bin_words_; ++word) {
+            uint64_t bits = ~0ULL;
+            for (auto i = 0; i < num_hash_; ++i)
+                bits &= rows[i][word];
+            result[word] = bits;
+        }
+    }
+};
+
+// Membership agent over whichever layout the Index currently holds. Each query returns a pointer to
+// (num_bins + 63) / 64 words with a 1 for each bin containing the hash. The pointer is only valid until the next query.
+class IndexAgent {
+private:
+    using compressed_agent_type = seqan3::interleaved_bloom_filter<seqan3::data_layout::compressed>::membership_agent_type;
+    using uncompressed_agent_type = seqan3::interleaved_bloom_filter<seqan3::data_layout::uncompressed>::membership_agent_type;
+
+    IndexLayout layout_{IndexLayout::compressed};
+    compressed_agent_type compressed_agent_{};
+    uncompressed_agent_type uncompressed_agent_{};
+    const BlockedBloomFilter *blocked_{nullptr};
+    const ExactIndex *exact_{nullptr};
+    UncompressedIBFView ibf_view_{};
+    bool batched_{false}; // whether bulk_contains of many values can use ibf_view_
+    std::vector<uint64_t> result_buffer_{};
+
+    // number of values whose memory is requested before the first of them is read
+    static constexpr size_t batch_size{32};
+
+    // Check the replicated IBF hashing gives the same result as seqan3 for some arbitrary values
+    bool check_view() {
+        std::vector<uint64_t> result(ibf_view_.num_words());
+        std::array<const uint64_t *, 5> rows{};
+        uint64_t value = 0x9E3779B97F4A7C15ULL;
+        for (auto n = 0; n < 256; ++n) {
+            value = mix64(value + n);
+            for (auto i = 0; i < ibf_view_.num_hash(); ++i)
+                rows[i] = ibf_view_.row(value, i);
+            ibf_view_.contains(rows, result.data());
+            const auto *expected = uncompressed_agent_.bulk_contains(value).raw_data().data();
+            if (not std::equal(result.begin(), result.end(), expected))
+                return false;
+        }
+        return true;
+    }
+
+public:
+    IndexAgent() = default;
+
+    IndexAgent(IndexAgent const &) = default;
+
+    IndexAgent(IndexAgent &&) = default;
+
+    IndexAgent &operator=(IndexAgent const &) = default;
+
+    IndexAgent &operator=(IndexAgent &&) = default;
+
+    ~IndexAgent() = default;
+
+    explicit IndexAgent(const seqan3::interleaved_bloom_filter<seqan3::data_layout::compressed> &ibf) :
+            layout_{IndexLayout::compressed},
+            compressed_agent_{ibf.membership_agent()} {}
+
+    explicit IndexAgent(const seqan3::interleaved_bloom_filter<seqan3::data_layout::uncompressed> &ibf) :
+            layout_{IndexLayout::uncompressed},
+            uncompressed_agent_{ibf.membership_agent()},
+            ibf_view_(ibf) {
+        batched_ = ibf_view_.num_hash() <= 5 and check_view();
+        if (not batched_)
+            PLOG_WARNING << "Batched lookups do not match the IBF, falling back to single lookups";
+    }
+
+    explicit IndexAgent(const BlockedBloomFilter &filter) :
+            layout_{IndexLayout::blocked},
+            blocked_{&filter},
+            result_buffer_(filter.num_words(), 0) {}
+
+    explicit IndexAgent(const ExactIndex &exact) :
+            layout_{IndexLayout::exact},
+            exact_{&exact} {}
+
+    IndexLayout layout() const {
+        return layout_;
+    }
+
+    const uint64_t *bulk_contains(const uint64_t value) {
+        switch (layout_) {
+            case IndexLayout::uncompressed:
+                return uncompressed_agent_.bulk_contains(value).raw_data().data();
+            case IndexLayout::blocked:
+                return blocked_->bulk_contains(value, result_buffer_.data());
+            case IndexLayout::exact:
+                return exact_->bulk_contains(value);
+            default:
+                return compressed_agent_.bulk_contains(value).raw_data().data();
+        }
+    }
+
+    // A key for the value such that values with nearby keys are looked up in nearby memory
+    uint64_t locality_key(const uint64_t value) const {
+        switch (layout_) {
+            case IndexLayout::uncompressed:
+                return ibf_view_.position(value);
+            case IndexLayout::blocked:
+                return blocked_->block_index(value);
+            case IndexLayout::exact:
+                return exact_->slot_index(value);
+            default:
+                return value;
+        }
+    }
+
+    // Appends a row to hits for each value. The memory for a batch of values is prefetched before any of it is read,
+    // so that many cache misses are in flight at once rather than stalling on each in turn.
+    void bulk_contains(std::span<const uint64_t> values, HitMatrix &hits) {
+        switch (layout_) {
+            case IndexLayout::uncompressed: {
+                if (not batched_)
+                    break;
+                std::array<std::array<const uint64_t *, 5>, batch_size> rows{};
+                for (size_t start = 0; start < values.size(); start += batch_size) {
+                    const auto end = std::min(values.size(), start + batch_size);
+                    for (auto j = start; j < end; ++j) {
+                        for (auto i = 0; i < ibf_view_.num_hash(); ++i) {
+                            rows[j - start][i] = ibf_view_.row(values[j], i);
+                            __builtin_prefetch(rows[j - start][i]);
+                        }
+                    }
+                    for (auto j = start; j < end; ++j)
+                        ibf_view_.contains(rows[j - start], hits.append_row());
+                }
+                return;
+            }
+            case IndexLayout::blocked: {
+                for (size_t start = 0; start < values.size(); start += batch_size) {
+                    const auto end = std::min(values.size(), start + batch_size);
+                    for (auto j = start; j < end; ++j)
+                        __builtin_prefetch(blocked_->block(values[j]));
+                    for (auto j = start; j < end; ++j)
+                        blocked_->bulk_contains(values[j], hits.append_row());
+                }
+                return;
+            }
+            case IndexLayout::exact: {
+                for (size_t start = 0; start < values.size(); start += batch_size) {
+                    const auto end = std::min(values.size(), start + batch_size);
+                    for (auto j = start; j < end; ++j)
+                        __builtin_prefetch(exact_->slot(values[j]));
+                    for (auto j = start; j < end; ++j)
+                        hits.append(exact_->bulk_contains(values[j]));
+                }
+                return;
+            }
+            default:
+                break;
+        }
+        // the compressed IBF has no cheap way to compute addresses ahead of the lookup
+        for (const auto &value: values)
+            hits.append(bulk_contains(value));
+    }
+};
+
+#endif // CHARON_INDEX_AGENT_H
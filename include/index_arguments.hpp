@@ -20,6 +20,10 @@ struct IndexArguments {
     mutable size_t bits{std::numeric_limits<uint32_t>::max() - 2}; // Allow to change bits for each partition
     uint8_t num_hash{3};
     double max_fpr{0.01};
+    bool blocked{false};
+    bool exact{false};
+    uint16_t triage_rate{0};
+    uint16_t prefilter_rate{0};
 
     // General options
     std::string log_file{"charon.log"};
@@ -39,7 +43,11 @@ struct IndexArguments {
         ss += "\tkmer_size:\t\t" + std::to_string(kmer_size) + "\n\n";
 
         ss += "\tnum_hash:\t\t" + std::to_string(num_hash) + "\n";
-        ss += "\tmax_fpr:\t\t" + std::to_string(max_fpr) + "\n\n";
+        ss += "\tmax_fpr:\t\t" + std::to_string(max_fpr) + "\n";
+        ss += "\tblocked:\t\t" + std::to_string(blocked) + "\n";
+        ss += "\texact:\t\t\t" + std::to_string(exact) + "\n";
+        ss += "\ttriage_rate:\t\t" + std::to_string(triage_rate) + "\n";
+        ss += "\tprefilter_rate:\t\t" + std::to_string(prefilter_rate) + "\n\n";
 
         ss += "\toptimize:\t\t" + std::to_string(optimize) + "\n\n";
 
@@ -13,6 +13,10 @@
 
 class Index;
 
+class BlockedBloomFilter;
+
+class SingleBinBlockedBloomFilter;
+
 class InputStats;
 
 class InputSummary;
@@ -27,6 +31,20 @@ InputStats count_and_store_hashes(const IndexArguments &opt, const InputSummary
 std::unordered_map<uint8_t, std::vector<uint8_t>>
 optimize_layout(const IndexArguments &opt, InputSummary &summary, InputStats &stats);
 
+Index build_blocked_index(const IndexArguments &opt, const InputSummary &summary, InputStats &stats,
+                          const std::unordered_map<uint8_t, std::vector<uint8_t>> &bucket_to_bins_map);
+
+Index build_exact_index(const IndexArguments &opt, const InputSummary &summary, InputStats &stats,
+                        const std::unordered_map<uint8_t, std::vector<uint8_t>> &bucket_to_bins_map);
+
+seqan3::interleaved_bloom_filter<seqan3::data_layout::uncompressed>
+build_triage_ibf(const IndexArguments &opt, const InputSummary &summary, InputStats &stats,
+                 const std::unordered_map<uint8_t, std::vector<uint8_t>> &bucket_to_bins_map);
+
+SingleBinBlockedBloomFilter
+build_host_prefilter(const IndexArguments &opt, const InputSummary &summary,
+                     const std::unordered_map<uint8_t, std::vector<uint8_t>> &bucket_to_bins_map);
+
 Index build_index(const IndexArguments &opt, const InputSummary &summary, InputStats &stats,
                   const std::unordered_map<uint8_t, std::vector<uint8_t>> &bucket_to_bins_map);
 
@@ -0,0 +1,246 @@
+#ifndef CHARON_INDEX_SET_H
+#define CHARON_INDEX_SET_H
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <plog/Log.h>
+
+#include <index.hpp>
+#include <index_agent.hpp>
+#include <input_summary.hpp>
+
+// Membership agent over several indexes. Each query is answered by every index and the per-bin words are concatenated
+// in the order the indexes were added, so bin b of the i-th index becomes bin b + (number of bins in earlier indexes).
+// With a single index the words are returned directly without copying.
+class IndexSetAgent {
+private:
+    std::vector<IndexAgent> agents_{};
+    std::vector<uint16_t> bin_offsets_{};
+    std::vector<uint8_t> num_bins_{};
+    std::vector<uint64_t> result_buffer_{};
+    std::vector<HitMatrix> agent_hits_{}; // rows from each index before they are concatenated
+
+public:
+    IndexSetAgent() = default;
+
+    IndexSetAgent(IndexSetAgent const &) = default;
+
+    IndexSetAgent(IndexSetAgent &&) = default;
+
+    IndexSetAgent &operator=(IndexSetAgent const &) = default;
+
+    IndexSetAgent &operator=(IndexSetAgent &&) = default;
+
+    ~IndexSetAgent() = default;
+
+    void add(IndexAgent &&agent, const uint8_t num_bins) {
+        const uint16_t offset = bin_offsets_.empty() ? 0 : bin_offsets_.back() + num_bins_.back();
+        agents_.push_back(std::move(agent));
+        bin_offsets_.push_back(offset);
+        num_bins_.push_back(num_bins);
+        result_buffer_.resize((offset + num_bins + 63) / 64, 0);
+        agent_hits_.resize(agents_.size());
+    }
+
+    std::string layout_name() const {
+        std::string name;
+        for (const auto &agent: agents_) {
+            if (not name.empty())
+                name += "+";
+            name += ::layout_name(agent.layout());
+        }
+        return name;
+    }
+
+    // Values are ordered by where they are found in the first index
+    uint64_t locality_key(const uint64_t value) const {
+        return agents_.front().locality_key(value);
+    }
+
+    // Or the words of the i-th index into result at the bin offset of that index
+    inline void concatenate(const uint8_t i, const uint64_t *entry, uint64_t *result) const {
+        const auto &offset = bin_offsets_[i];
+        const auto &num_bins = num_bins_[i];
+        const auto num_words = (num_bins + 63) / 64;
+        const auto shift = offset & 63;
+        for (auto word = 0; word < num_words; ++word) {
+            auto bits = entry[word];
+            const auto bins_in_word = num_bins - word * 64;
+            if (bins_in_word < 64)
+                bits &= (1ULL << bins_in_word) - 1;
+            const auto target = (offset >> 6) + word;
+            result[target] |= bits << shift;
+            if (shift > 0 and target + 1 < result_buffer_.size())
+                result[target + 1] |= bits >> (64 - shift);
+        }
+    }
+
+    const uint64_t *bulk_contains(const uint64_t value) {
+        if (agents_.size() == 1)
+            return agents_.front().bulk_contains(value);
+
+        std::fill(result_buffer_.begin(), result_buffer_.end(), 0);
+        for (auto i = 0; i < agents_.size(); ++i)
+            concatenate(i, agents_[i].bulk_contains(value), result_buffer_.data());
+        return result_buffer_.data();
+    }
+
+    // Appends a row to hits for each value, using the batched lookup of each index
+    void bulk_contains(std::span<const uint64_t> values, HitMatrix &hits) {
+        if (agents_.size() == 1) {
+            agents_.front().bulk_contains(values, hits);
+            return;
+        }
+
+        for (auto i = 0; i < agents_.size(); ++i) {
+            agent_hits_[i].reset((num_bins_[i] + 63) / 64, values.size());
+            agents_[i].bulk_contains(values, agent_hits_[i]);
+        }
+        for (auto j = 0; j < values.size(); ++j) {
+            auto *row = hits.append_row();
+            std::fill(row, row + result_buffer_.size(), 0);
+            for (auto i = 0; i < agents_.size(); ++i)
+                concatenate(i, agent_hits_[i].view().row(j), row);
+        }
+    }
+};
+
+// One or more indexes built with the same k-mer and window size, queried together as if they were a single index with
+// the bins of each concatenated and the categories merged by name. This lets a frequently rebuilt index be combined
+// with one that rarely changes without rebuilding both.
+class IndexSet {
+private:
+    std::vector<Index> indexes_{};
+    InputSummary summary_{};
+    uint8_t prefilter_index_{std::numeric_limits<uint8_t>::max()}; // the index whose host prefilter is used
+
+public:
+    IndexSet() = default;
+
+    IndexSet(IndexSet const &) = default;
+
+    IndexSet(IndexSet &&) = default;
+
+    IndexSet &operator=(IndexSet const &) = default;
+
+    IndexSet &operator=(IndexSet &&) = default;
+
+    ~IndexSet() = default;
+
+    void add(Index &&index) {
+        if (not indexes_.empty() and
+            (index.kmer_size() != kmer_size() or index.window_size() != window_size())) {
+            PLOG_ERROR << "Cannot combine an index with kmer size " << +index.kmer_size() << " and window size "
+                       << +index.window_size() << " with one with kmer size " << +kmer_size() << " and window size "
+                       << +window_size();
+            exit(1);
+        }
+        if (summary_.num_bins + index.num_bins() > std::numeric_limits<uint8_t>::max()) {
+            PLOG_ERROR << "Cannot combine indexes with more than " << +std::numeric_limits<uint8_t>::max()
+                       << " bins in total";
+            exit(1);
+        }
+        summary_.merge(index.summary());
+        if (not has_prefilter() and index.has_prefilter())
+            prefilter_index_ = indexes_.size();
+        indexes_.push_back(std::move(index));
+    }
+
+    std::vector<Index> &indexes() {
+        return indexes_;
+    }
+
+    const std::vector<Index> &indexes() const {
+        return indexes_;
+    }
+
+    uint8_t window_size() const {
+        return indexes_.front().window_size();
+    }
+
+    uint8_t kmer_size() const {
+        return indexes_.front().kmer_size();
+    }
+
+    uint8_t num_bins() const {
+        return summary_.num_bins;
+    }
+
+    uint8_t num_categories() const {
+        return summary_.num_categories();
+    }
+
+    std::vector<std::string> categories() const {
+        return summary_.categories;
+    }
+
+    uint8_t get_host_index() const {
+        const auto index1 = summary_.category_index("host");
+        const auto index2 = summary_.category_index("human");
+        auto index = std::min(index1, index2);
+        if (index == std::numeric_limits<uint8_t>::max())
+            PLOG_ERROR << "Index does not contain 'host' or 'human' as a category ";
+        assert(index < std::numeric_limits<uint8_t>::max());
+        return index;
+    }
+
+    uint8_t get_category_index(const std::string category) const {
+        const auto index = summary_.category_index(category);
+        if (index == std::numeric_limits<uint8_t>::max())
+            PLOG_ERROR << "Index does not contain category ";
+        assert(index < std::numeric_limits<uint8_t>::max());
+        return index;
+    }
+
+    const InputSummary &summary() const {
+        return summary_;
+    }
+
+    // The triage indexes can only be combined if every index has one sampled at the same rate
+    bool has_triage() const {
+        for (const auto &index: indexes_) {
+            if (not index.has_triage() or index.triage_rate() != indexes_.front().triage_rate())
+                return false;
+        }
+        return not indexes_.empty();
+    }
+
+    bool in_triage_sample(const uint64_t value) const {
+        return indexes_.front().in_triage_sample(value);
+    }
+
+    // The host prefilter is taken from the first index which has one, as the host is normally in a single index
+    bool has_prefilter() const {
+        return prefilter_index_ < indexes_.size();
+    }
+
+    bool in_prefilter_sample(const uint64_t value) const {
+        return indexes_[prefilter_index_].in_prefilter_sample(value);
+    }
+
+    bool prefilter_contains(const uint64_t value) const {
+        return indexes_[prefilter_index_].prefilter_contains(value);
+    }
+
+    IndexSetAgent triage_agent() const {
+        IndexSetAgent agent;
+        for (const auto &index: indexes_)
+            agent.add(index.triage_agent(), index.num_bins());
+        return agent;
+    }
+
+    IndexSetAgent agent() const {
+        IndexSetAgent agent;
+        for (const auto &index: indexes_)
+            agent.add(index.agent(), index.num_bins());
+        return agent;
+    }
+};
+
+#endif // CHARON_INDEX_SET_H
@@ -36,7 +36,7 @@ public:
         return categories.size();
     }
 
-    uint8_t category_index(const std::string category) const {
+    uint8_t category_index(const std::string &category) const {
         for (auto i = 0; i < categories.size(); ++i) {
             if (category == categories.at(i))
                 return i;
@@ -61,6 +61,20 @@ public:
             return categories.at(index);
     }
 
+    // Append the bins of another summary after those of this one, adding any categories not already present
+    void merge(const InputSummary &other) {
+        const auto offset = num_bins;
+        for (const auto &category: other.categories) {
+            if (category_index(category) == std::numeric_limits<uint8_t>::max())
+                categories.push_back(category);
+        }
+        for (const auto &[filepath, bin]: other.filepath_to_bin)
+            filepath_to_bin.emplace_back(filepath, offset + bin);
+        for (const auto &[bin, category]: other.bin_to_category)
+            bin_to_category[offset + bin] = category;
+        num_bins += other.num_bins;
+    }
+
     template<seqan3::cereal_archive archive_t>
     void CEREAL_SERIALIZE_FUNCTION_NAME(archive_t &archive) {
         try {
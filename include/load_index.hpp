@@ -5,7 +5,14 @@
 
 #include <filesystem>
 #include <index.hpp>
+#include <index_set.hpp>
 
 void load_index(Index &index, std::filesystem::path const &path);
 
+void set_index_layout(Index &index, const std::string &layout, std::filesystem::path const &path,
+                      const uint8_t threads);
+
+void load_indexes(IndexSet &indexes, const std::vector<std::string> &paths, const std::string &layout,
+                  const uint8_t threads);
+
 #endif // CHARON_LOAD_INDEX_MAIN_H
\ No newline at end of file
@@ -0,0 +1,102 @@
+#ifndef CHARON_LONG_READ_H
+#define CHARON_LONG_READ_H
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <omp.h>
+
+#include "hit_matrix.hpp"
+#include "index_set.hpp"
+#include "minimiser.hpp"
+#include "read_entry.hpp"
+
+// Hashes and looks up the minimisers of reads longer than segment_length in segments of about segment_length bases,
+// run as OpenMP tasks so that other threads of the team can take some of them, e.g. threads which have run out of
+// reads while one very long read is still being processed. Must be used within an OpenMP parallel region.
+//
+// The k-mer values of each segment are computed separately and the minimisers are then found over all of them in one
+// pass, so they are exactly those of the whole read. The minimisers are looked up in consecutive ranges, one per
+// segment, into separate hit matrices which are then appended to the read in order. The read therefore ends up with
+// the same rows as if it had been processed in one piece, and is called identically.
+class LongReadSplitter {
+private:
+    uint32_t segment_length_{0};
+    std::vector<uint64_t> values_{}; // values of all k-mers of the read being split
+    std::vector<HitMatrix> segment_hits_{};
+    std::vector<IndexSetAgent> segment_agents_{}; // agents keep lookup buffers, so each task needs its own
+
+    uint32_t num_segments(const uint64_t length) const {
+        return (length + segment_length_ - 1) / segment_length_;
+    }
+
+public:
+    LongReadSplitter() = default;
+
+    LongReadSplitter(LongReadSplitter const &) = default;
+
+    LongReadSplitter(LongReadSplitter &&) = default;
+
+    LongReadSplitter &operator=(LongReadSplitter const &) = default;
+
+    LongReadSplitter &operator=(LongReadSplitter &&) = default;
+
+    ~LongReadSplitter() = default;
+
+    explicit LongReadSplitter(const uint32_t segment_length) :
+            segment_length_(segment_length) {}
+
+    bool should_split(const uint64_t length) const {
+        return segment_length_ > 0 and length > segment_length_;
+    }
+
+    // Appends the minimisers of sequence to minimisers, as hasher.compute would
+    template<typename sequence_t>
+    void compute(MinimiserHasher &hasher, const sequence_t &sequence, std::vector<uint64_t> &minimisers) {
+        const uint64_t length = std::ranges::size(sequence);
+        if (not should_split(length) or not hasher.has_kernel()) {
+            hasher.compute(sequence, minimisers);
+            return;
+        }
+
+        const uint64_t num_kmers = hasher.num_kmers(length);
+        const uint64_t segment_length = segment_length_;
+        values_.resize(num_kmers);
+        uint64_t *values = values_.data();
+#pragma omp taskloop shared(hasher, sequence) firstprivate(values, num_kmers, segment_length) grainsize(1)
+        for (uint64_t first = 0; first < num_kmers; first += segment_length)
+            hasher.compute_values(sequence, first, std::min(first + segment_length, num_kmers), values);
+        hasher.compute_from_values(std::span<const uint64_t>(values_.data(), num_kmers), minimisers);
+    }
+
+    // Looks up values for the read, as read.update_entries(agent, values) would. length is the length of the read,
+    // which decides whether the lookups are split.
+    void update_entries(IndexSetAgent &agent, ReadEntry &read, const std::vector<uint64_t> &values,
+                        const uint64_t length, const uint16_t num_words) {
+        if (not should_split(length) or values.size() < 2) {
+            read.update_entries(agent, values);
+            return;
+        }
+
+        const uint32_t segments = std::min<uint64_t>(num_segments(length), values.size());
+        const uint64_t rows_per_segment = (values.size() + segments - 1) / segments;
+        segment_hits_.resize(segments);
+        segment_agents_.resize(segments, agent);
+#pragma omp taskloop shared(values) firstprivate(num_words, rows_per_segment) grainsize(1)
+        for (uint32_t segment = 0; segment < segments; ++segment) {
+            const auto first = std::min<uint64_t>(segment * rows_per_segment, values.size());
+            const auto count = std::min<uint64_t>(rows_per_segment, values.size() - first);
+            segment_hits_[segment].reset(num_words, count);
+            segment_agents_[segment].bulk_contains(std::span<const uint64_t>(values).subspan(first, count),
+                                                   segment_hits_[segment]);
+        }
+        for (uint32_t segment = 0; segment < segments; ++segment)
+            read.append_entries(segment_hits_[segment].view());
+    }
+};
+
+#endif // CHARON_LONG_READ_H
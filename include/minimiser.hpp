@@ -0,0 +1,270 @@
+#ifndef CHARON_MINIMISER_H
+#define CHARON_MINIMISER_H
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <bit>
+#include <cstdint>
+#include <random>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include <plog/Log.h>
+#include <seqan3/alphabet/nucleotide/dna5.hpp>
+#include <seqan3/search/views/minimiser_hash.hpp>
+
+// Computes the same values as seqan3::views::minimiser_hash with an ungapped shape of size k, window size w and the
+// default seed, without going through the range adaptors.
+//
+// Like seqan3, each k-mer is hashed in base 5 on dna5 ranks (A, C, G, N, T), for the k-mer and its reverse complement,
+// and the smaller of the two after xor with the seed is its value. These are computed with rolling hashes and fed to a
+// monotone deque giving the minimum over each window of w - k + 1 values, emitting a value whenever seqan3 would: for
+// the first window, when the current minimiser leaves the window (replaced by the rightmost minimum of the new window),
+// and when a new value is strictly smaller than the current minimiser.
+//
+// For very long sequences the k-mer values can instead be computed in separate ranges, e.g. on several threads, with
+// compute_values and the minimisers then found from them with compute_from_values.
+//
+// The defaults k = 19, w = 41 get a version with the constants known at compile time. On construction the output is
+// compared with the seqan3 adaptor on random sequences, and the adaptor is used instead if they ever differ.
+class MinimiserHasher {
+private:
+    static constexpr uint64_t seed{0x8F3F73B5CF1C9ADEULL};
+    static constexpr std::array<uint8_t, 5> complement_rank{4, 2, 1, 3, 0};
+
+    uint8_t kmer_size_{0};
+    uint8_t window_size_{0};
+    bool use_kernel_{true};
+    std::vector<uint64_t> values_{}; // values of the k-mers in the current window, indexed by position & mask
+    std::vector<uint64_t> deque_{}; // positions in the window with increasing values, used as a fixed size deque
+
+    static constexpr uint64_t power_of_5(const uint8_t exponent) {
+        uint64_t result = 1;
+        for (auto i = 0; i < exponent; ++i)
+            result *= 5;
+        return result;
+    }
+
+    // State of the minimum over the current window, kept in deque_ as positions with increasing values
+    struct WindowState {
+        uint64_t head{0};
+        uint64_t size{0};
+        uint64_t current{0}; // position of the current minimiser
+    };
+
+    // Calls visit(position, value) for the k-mers starting at positions first to last - 1, using rolling hashes
+    template<typename sequence_t, typename kmer_t, typename visit_t>
+    static void for_each_kmer_value(const sequence_t &sequence, const kmer_t k, const uint64_t first,
+                                    const uint64_t last, visit_t &&visit) {
+        const auto roll_factor = power_of_5(k - 1);
+        uint64_t forward = 0;
+        uint64_t reverse = 0;
+        for (uint64_t i = first; i + 1 < first + k; ++i) {
+            const auto rank = seqan3::to_rank(sequence[i]);
+            forward = forward * 5 + rank;
+            reverse += complement_rank[rank] * power_of_5(i - first);
+        }
+
+        for (uint64_t i = first + k - 1; i + 1 < last + k; ++i) {
+            const auto rank = seqan3::to_rank(sequence[i]);
+            forward = forward * 5 + rank;
+            reverse += complement_rank[rank] * roll_factor;
+            visit(i + 1 - k, std::min(forward ^ seed, reverse ^ seed));
+
+            const auto first_rank = seqan3::to_rank(sequence[i + 1 - k]);
+            forward -= first_rank * roll_factor;
+            reverse = (reverse - complement_rank[first_rank]) / 5;
+        }
+    }
+
+    // Adds the value of the k-mer at position to the window of the span k-mers ending there, appending a minimiser to
+    // minimisers whenever seqan3 would. value_at(p) gives the value of any k-mer p still in the window.
+    template<typename value_at_t>
+    inline void push_value(const uint64_t position, const uint64_t value, const uint64_t span, const uint64_t mask,
+                           value_at_t &&value_at, WindowState &state, std::vector<uint64_t> &minimisers) {
+        // drop the position leaving the window before pushing, so the deque never holds more than span
+        const auto first = position + 1 > span ? position + 1 - span : 0;
+        if (state.size > 0 and deque_[state.head] < first) {
+            state.head = (state.head + 1) & mask;
+            --state.size;
+        }
+        while (state.size > 0 and value_at(deque_[(state.head + state.size - 1) & mask]) >= value)
+            --state.size;
+        deque_[(state.head + state.size) & mask] = position;
+        ++state.size;
+
+        if (position + 1 == span) {
+            state.current = deque_[state.head];
+            minimisers.push_back(value_at(state.current));
+        } else if (position + 1 > span) {
+            if (state.current < first) {
+                state.current = deque_[state.head];
+                minimisers.push_back(value_at(state.current));
+            } else if (value < value_at(state.current)) {
+                state.current = position;
+                minimisers.push_back(value);
+            }
+        }
+    }
+
+    // k and window are either integers or std::integral_constant, so the fixed version folds the constants
+    template<typename sequence_t, typename kmer_t, typename window_t>
+    void compute_kernel(const sequence_t &sequence, const kmer_t k, const window_t window,
+                        std::vector<uint64_t> &minimisers) {
+        const uint64_t length = std::ranges::size(sequence);
+        if (length < k)
+            return;
+        const uint64_t num_kmers = length - k + 1;
+        const uint64_t span = std::min<uint64_t>(window, num_kmers);
+
+        // only the values of the k-mers in the current window are kept, in ring buffers with a power of 2 size of at
+        // least span, so memory does not grow with the length of the sequence (e.g. whole chromosomes when indexing)
+        const uint64_t mask = std::bit_ceil(span) - 1;
+        values_.resize(mask + 1);
+        deque_.resize(mask + 1);
+        WindowState state;
+        const auto value_at = [&](const uint64_t position) { return values_[position & mask]; };
+        for_each_kmer_value(sequence, k, 0, num_kmers, [&](const uint64_t position, const uint64_t value) {
+            values_[position & mask] = value;
+            push_value(position, value, span, mask, value_at, state, minimisers);
+        });
+    }
+
+    template<uint8_t k, uint8_t w, typename sequence_t>
+    void compute_fixed(const sequence_t &sequence, std::vector<uint64_t> &minimisers) {
+        compute_kernel(sequence, std::integral_constant<uint64_t, k>{}, std::integral_constant<uint64_t, w - k + 1>{},
+                       minimisers);
+    }
+
+    template<typename sequence_t>
+    void compute_adaptor(const sequence_t &sequence, std::vector<uint64_t> &minimisers) const {
+        auto hash_adaptor = seqan3::views::minimiser_hash(seqan3::shape{seqan3::ungapped{kmer_size_}},
+                                                          seqan3::window_size{window_size_});
+        for (auto &&value: sequence | hash_adaptor)
+            minimisers.push_back(value);
+    }
+
+    bool self_check() {
+        std::mt19937_64 generator(kmer_size_ * 256 + window_size_);
+        std::vector<seqan3::dna5> sequence;
+        std::vector<uint64_t> expected;
+        std::vector<uint64_t> found;
+        std::vector<uint64_t> values;
+        for (auto trial = 0; trial < 64; ++trial) {
+            // include reads shorter than a window and low complexity reads with repeated minima
+            const auto length = generator() % (4 * window_size_ + 1);
+            const auto num_letters = trial % 4 == 0 ? 2 : 5;
+            sequence.resize(length);
+            for (auto &base: sequence)
+                base.assign_rank(generator() % num_letters);
+            expected.clear();
+            found.clear();
+            compute_adaptor(sequence, expected);
+            compute(sequence, found);
+            if (found != expected)
+                return false;
+
+            // the same from values computed in two ranges
+            const auto num_values = num_kmers(length);
+            const auto middle = num_values / 2;
+            values.resize(num_values);
+            compute_values(sequence, 0, middle, values.data());
+            compute_values(sequence, middle, num_values, values.data());
+            found.clear();
+            compute_from_values(values, found);
+            if (found != expected)
+                return false;
+        }
+        return true;
+    }
+
+public:
+    MinimiserHasher() = default;
+
+    MinimiserHasher(MinimiserHasher const &) = default;
+
+    MinimiserHasher(MinimiserHasher &&) = default;
+
+    MinimiserHasher &operator=(MinimiserHasher const &) = default;
+
+    MinimiserHasher &operator=(MinimiserHasher &&) = default;
+
+    ~MinimiserHasher() = default;
+
+    MinimiserHasher(const uint8_t kmer_size, const uint8_t window_size) :
+            kmer_size_(kmer_size),
+            window_size_(window_size) {
+        // 5^k must fit in 64 bits
+        if (kmer_size_ == 0 or kmer_size_ > 27 or window_size_ < kmer_size_) {
+            use_kernel_ = false;
+        } else if (not self_check()) {
+            PLOG_WARNING << "Minimiser kernel does not match seqan3 for k=" << +kmer_size_ << " w=" << +window_size_
+                         << ", using the seqan3 adaptor";
+            use_kernel_ = false;
+        }
+        PLOG_DEBUG << "Hashing minimisers with the " << name() << " kernel";
+    }
+
+    std::string name() const {
+        if (not use_kernel_)
+            return "seqan3";
+        if (kmer_size_ == 19 and window_size_ == 41)
+            return "k19w41";
+        return "rolling";
+    }
+
+    // Whether compute_values and compute_from_values can be used instead of compute
+    bool has_kernel() const {
+        return use_kernel_;
+    }
+
+    uint64_t num_kmers(const uint64_t length) const {
+        return length < kmer_size_ ? 0 : length - kmer_size_ + 1;
+    }
+
+    // Writes the values of the k-mers of sequence starting at positions first to last - 1 to values[first] onwards.
+    // Only reads the sequence, so separate ranges of the same sequence can be computed concurrently.
+    template<typename sequence_t>
+    void compute_values(const sequence_t &sequence, const uint64_t first, const uint64_t last,
+                        uint64_t *values) const {
+        assert(use_kernel_ and last <= num_kmers(std::ranges::size(sequence)));
+        if (first >= last)
+            return;
+        for_each_kmer_value(sequence, static_cast<uint64_t>(kmer_size_), first, last,
+                            [values](const uint64_t position, const uint64_t value) { values[position] = value; });
+    }
+
+    // Appends the minimisers of a sequence to minimisers given the values of all its k-mers, as from compute_values.
+    // Together these give the same minimisers as compute.
+    void compute_from_values(std::span<const uint64_t> values, std::vector<uint64_t> &minimisers) {
+        assert(use_kernel_);
+        if (values.empty())
+            return;
+        const uint64_t span = std::min<uint64_t>(window_size_ - kmer_size_ + 1, values.size());
+        const uint64_t mask = std::bit_ceil(span) - 1;
+        deque_.resize(mask + 1);
+        WindowState state;
+        const auto value_at = [values](const uint64_t position) { return values[position]; };
+        for (uint64_t position = 0; position < values.size(); ++position)
+            push_value(position, values[position], span, mask, value_at, state, minimisers);
+    }
+
+    // Appends the minimisers of sequence (a range of dna5) to minimisers
+    template<typename sequence_t>
+    void compute(const sequence_t &sequence, std::vector<uint64_t> &minimisers) {
+        if (not use_kernel_) {
+            compute_adaptor(sequence, minimisers);
+        } else if (kmer_size_ == 19 and window_size_ == 41) {
+            compute_fixed<19, 41>(sequence, minimisers);
+        } else {
+            compute_kernel(sequence, static_cast<uint64_t>(kmer_size_),
+                           static_cast<uint64_t>(window_size_ - kmer_size_ + 1), minimisers);
+        }
+    }
+};
+
+#endif // CHARON_MINIMISER_H
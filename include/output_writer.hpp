@@ -0,0 +1,207 @@
+#ifndef CHARON_OUTPUT_WRITER_H
+#define CHARON_OUTPUT_WRITER_H
+
+#pragma once
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <omp.h>
+#include <plog/Log.h>
+
+// Writes the assignment lines of the reads from a dedicated thread, so that the worker threads only format lines.
+//
+// By default each worker formats its lines into its own buffer, which is handed to the writer thread once it holds
+// block_size bytes and written with a single write(), so lines from different threads are interleaved in blocks. With
+// ordered, lines are kept in a reorder buffer indexed by the position of the read in the input and written as soon as
+// all earlier reads have been written. Memory is bounded in both cases: workers wait if more than max_queued_bytes are
+// waiting to be written, or in ordered mode if their read is max_pending reads or more ahead of the next to be written.
+class AssignmentWriter {
+private:
+    static constexpr size_t block_size{1 << 20};
+    static constexpr size_t max_queued_bytes{64 << 20};
+
+    struct alignas(64) ThreadBuffer {
+        std::string text;
+    };
+
+    int fd_{STDOUT_FILENO};
+    bool ordered_{false};
+    uint64_t max_pending_{0};
+    std::vector<ThreadBuffer> thread_buffers_{};
+
+    std::mutex mutex_;
+    std::condition_variable has_work_;
+    std::condition_variable has_space_;
+    std::deque<std::string> queue_{}; // blocks ready to write
+    size_t queued_bytes_{0};
+    std::map<uint64_t, std::string> pending_{}; // ordered lines waiting for earlier reads, by read index
+    uint64_t next_index_{0}; // index of the next read to write in ordered mode
+    bool closing_{false};
+    std::thread thread_;
+
+    uint64_t num_bytes_written_{0};
+    uint64_t num_writes_{0};
+
+    void write_all(const std::string &text) {
+        size_t offset = 0;
+        while (offset < text.size()) {
+            const auto written = ::write(fd_, text.data() + offset, text.size() - offset);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                PLOG_ERROR << "Failed to write assignments: " << std::strerror(errno);
+                exit(1);
+            }
+            offset += written;
+        }
+        num_bytes_written_ += text.size();
+        num_writes_ += 1;
+    }
+
+    // Moves the lines of all consecutive reads from next_index_ into block, must hold the lock
+    void take_ordered(std::string &block) {
+        auto it = pending_.begin();
+        while (it != pending_.end() and it->first == next_index_) {
+            block += it->second;
+            queued_bytes_ -= it->second.size();
+            it = pending_.erase(it);
+            ++next_index_;
+        }
+    }
+
+    bool has_work() const {
+        return closing_ or not queue_.empty() or
+               (ordered_ and not pending_.empty() and pending_.begin()->first == next_index_);
+    }
+
+    void run() {
+        std::string block;
+        std::unique_lock lock(mutex_);
+        while (true) {
+            has_work_.wait(lock, [this] { return has_work(); });
+            block.clear();
+            if (not queue_.empty()) {
+                block.swap(queue_.front());
+                queue_.pop_front();
+                queued_bytes_ -= block.size();
+            }
+            if (ordered_)
+                take_ordered(block);
+            if (block.empty() and queue_.empty() and closing_)
+                break;
+
+            lock.unlock();
+            has_space_.notify_all();
+            if (not block.empty())
+                write_all(block);
+            lock.lock();
+        }
+    }
+
+    void hand_off(std::string &text) {
+        {
+            std::unique_lock lock(mutex_);
+            has_space_.wait(lock, [this] { return queued_bytes_ < max_queued_bytes; });
+            queued_bytes_ += text.size();
+            queue_.emplace_back();
+            queue_.back().swap(text);
+        }
+        has_work_.notify_one();
+        text.reserve(block_size);
+    }
+
+public:
+    AssignmentWriter(const std::string &output_file, const bool ordered, const uint8_t threads,
+                     const uint64_t max_pending) :
+            ordered_(ordered),
+            max_pending_(max_pending),
+            thread_buffers_(std::max<uint8_t>(threads, 1)) {
+        if (not output_file.empty() and output_file != "-") {
+            fd_ = ::open(output_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd_ < 0) {
+                PLOG_ERROR << "Could not open " << output_file << " for writing: " << std::strerror(errno);
+                exit(1);
+            }
+        }
+        thread_ = std::thread(&AssignmentWriter::run, this);
+    }
+
+    AssignmentWriter(AssignmentWriter const &) = delete;
+
+    AssignmentWriter &operator=(AssignmentWriter const &) = delete;
+
+    ~AssignmentWriter() {
+        close();
+    }
+
+    // Appends the line of the read at index in the input by calling format with the string to append it to
+    template<typename format_t>
+    void add(const uint64_t index, format_t &&format) {
+        if (not ordered_) {
+            auto &text = thread_buffers_.at(omp_get_thread_num()).text;
+            format(text);
+            if (text.size() >= block_size)
+                hand_off(text);
+            return;
+        }
+
+        std::string line;
+        format(line);
+        bool is_next = false;
+        {
+            std::unique_lock lock(mutex_);
+            // the next read must always be accepted, or nothing could be written
+            has_space_.wait(lock, [this, index] { return index < next_index_ + max_pending_; });
+            queued_bytes_ += line.size();
+            pending_.emplace(index, std::move(line));
+            is_next = index == next_index_;
+        }
+        if (is_next)
+            has_work_.notify_one();
+    }
+
+    // Records that the read at index has no line, so later reads are not held back waiting for it
+    void skip(const uint64_t index) {
+        if (ordered_)
+            add(index, [](std::string &) {});
+    }
+
+    // Writes everything left and stops the writer thread
+    void close() {
+        if (not thread_.joinable())
+            return;
+        {
+            std::unique_lock lock(mutex_);
+            for (auto &buffer: thread_buffers_) {
+                if (buffer.text.empty())
+                    continue;
+                queued_bytes_ += buffer.text.size();
+                queue_.emplace_back(std::move(buffer.text));
+                buffer.text.clear();
+            }
+            closing_ = true;
+        }
+        has_work_.notify_one();
+        thread_.join();
+        if (not pending_.empty())
+            PLOG_WARNING << pending_.size() << " assignment lines were not written as earlier reads never arrived";
+        if (fd_ != STDOUT_FILENO)
+            ::close(fd_);
+        PLOG_INFO << "Wrote " << num_bytes_written_ / 1000000.0 << " MB of assignments in " << num_writes_
+                  << " writes";
+    }
+};
+
+#endif // CHARON_OUTPUT_WRITER_H
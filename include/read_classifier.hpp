@@ -0,0 +1,473 @@
+#ifndef CHARON_READ_CLASSIFIER_H
+#define CHARON_READ_CLASSIFIER_H
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include <plog/Log.h>
+#include <seqan3/alphabet/quality/phred_base.hpp>
+
+#include "chunk_query.hpp"
+#include "complexity.hpp"
+#include "decompressed_input.hpp"
+#include "fastx_reader.hpp"
+#include "hit_matrix.hpp"
+#include "index_set.hpp"
+#include "long_read.hpp"
+#include "minimiser.hpp"
+#include "read_entry.hpp"
+#include "read_pipeline.hpp"
+#include "result.hpp"
+#include "sequential_test.hpp"
+#include "subsample.hpp"
+#include "utils.hpp"
+
+// The stages of the pipeline which only dehost runs, all off for classify, and how reads called from the full index
+// are reported
+struct PipelineSettings {
+    bool prefilter{false};
+    float prefilter_fraction{0};
+    uint16_t prefilter_min_hits{0};
+    bool cascade{false};
+    uint8_t triage_confidence{0};
+    uint32_t early_stop{0};
+    float early_stop_error{0};
+    bool dehost{false}; // reads called from the full index (or sorted chunk) are reported with dehost semantics
+};
+
+// What the workers did, summed over their reads and merged once per thread at the end of the pool
+struct PipelineCounters {
+    uint64_t num_lookups{0};
+    double lookup_seconds{0};
+    uint64_t num_subsampled{0};
+    uint64_t num_filtered{0};
+    uint64_t num_filtered_bases{0};
+    uint64_t num_prefilter_checked{0};
+    uint64_t num_prefiltered{0};
+    uint64_t num_triaged{0};
+    uint64_t num_second_tier{0};
+    uint64_t num_minimisers{0};
+    uint64_t num_minimisers_used{0};
+    uint64_t num_stopped_early{0};
+
+    void add(const PipelineCounters &other) {
+        num_lookups += other.num_lookups;
+        lookup_seconds += other.lookup_seconds;
+        num_subsampled += other.num_subsampled;
+        num_filtered += other.num_filtered;
+        num_filtered_bases += other.num_filtered_bases;
+        num_prefilter_checked += other.num_prefilter_checked;
+        num_prefiltered += other.num_prefiltered;
+        num_triaged += other.num_triaged;
+        num_second_tier += other.num_second_tier;
+        num_minimisers += other.num_minimisers;
+        num_minimisers_used += other.num_minimisers_used;
+        num_stopped_early += other.num_stopped_early;
+    }
+};
+
+// Takes each read of a batch through the stages of the pipeline: features (length, quality, complexity), the
+// filters of the trained model, the host prefilter and triage index, the lookup in the full index, and reporting the
+// read to the Result. Reads are either single or, if paired, the mates of batch.records and batch.records2.
+//
+// Each worker thread has its own copy, holding the hasher, agents and buffers reused from read to read, and the
+// counters of its reads.
+template<typename record_type, bool paired>
+class ReadClassifier {
+private:
+    const IndexSet *index_{nullptr};
+    Result<record_type> *result_{nullptr};
+    PipelineSettings settings_{};
+    bool sort_queries_{false};
+    bool gzip_complexity_{false};
+    uint16_t num_words_{0};
+    uint8_t host_index_{0};
+
+    IndexSetAgent agent_{};
+    IndexSetAgent triage_agent_{};
+    MinimiserHasher hasher_;
+    MinimiserSubsampler subsampler_;
+    ComplexityEstimator complexity_{};
+    LongReadSplitter splitter_;
+    SequentialTest test_{};
+
+    // storage reused across reads and batches
+    std::vector<uint64_t> minimisers_{};
+    HitMatrix hits_{};
+    HitMatrix triage_hits_{};
+
+    // used instead of per-read lookups with --sort_queries
+    ChunkQuery chunk_query_{};
+    std::vector<std::vector<uint64_t>> chunk_minimisers_{};
+    std::vector<ReadEntry> chunk_reads_{};
+    std::vector<uint8_t> chunk_ready_{};
+
+    PipelineCounters counters_{};
+    double busy_seconds_{0};
+
+    static double seconds_since(const std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Calls f on the read, or on each mate of a paired read
+    template<typename function_t>
+    static void for_each_mate(const ReadBatch<record_type> &batch, const size_t i, function_t &&f) {
+        f(batch.records[i]);
+        if constexpr (paired)
+            f(batch.records2[i]);
+    }
+
+    static void check_mate_ids(const record_type &record1, const record_type &record2) {
+        auto id1 = record1.id();
+        id1.erase(id1.size() - 1);
+        auto id2 = record2.id();
+        id2.erase(id2.size() - 1);
+        if (id1 != id2) {
+            std::cout << id1 << " " << id2;
+            throw std::runtime_error("Your pairs don't match for read ids.");
+        }
+    }
+
+    float compression_ratio(const ReadBatch<record_type> &batch, const size_t i) {
+        if constexpr (paired) {
+            const auto &record1 = batch.records[i];
+            const auto &record2 = batch.records2[i];
+            return gzip_complexity_ ? get_compression_ratio(sequence_to_string(record1.sequence()) +
+                                                            sequence_to_string(record2.sequence()))
+                                    : complexity_.compression_ratio(record1.sequence(), record2.sequence());
+        } else {
+            const auto &record = batch.records[i];
+            return gzip_complexity_ ? get_compression_ratio(sequence_to_string(record.sequence()))
+                                    : complexity_.compression_ratio(record.sequence());
+        }
+    }
+
+    // Reports a read called before the lookup in the full index, which needs no training
+    void report_called(const ReadEntry &read, const ReadBatch<record_type> &batch, const size_t i) {
+        if constexpr (paired)
+            result_->add_called_paired_read(read, batch.records[i], batch.records2[i]);
+        else
+            result_->add_called_read(read, batch.records[i]);
+    }
+
+    void report(ReadEntry &read, const ReadBatch<record_type> &batch, const size_t i, const bool dehost) {
+        if constexpr (paired)
+            result_->add_paired_read(read, batch.records[i], batch.records2[i], dehost);
+        else
+            result_->add_read(read, batch.records[i], dehost);
+    }
+
+    // Returns true if the read is called from the host prefilter
+    bool prefilter(ReadEntry &prefilter_read, const std::vector<uint64_t> &minimisers,
+                   const ReadBatch<record_type> &batch, const size_t i) {
+        uint32_t num_sampled = 0;
+        uint32_t num_prefilter_hits = 0;
+        const auto prefilter_start = std::chrono::steady_clock::now();
+        for (const auto &value: minimisers) {
+            if (index_->in_prefilter_sample(value)) {
+                num_sampled += 1;
+                num_prefilter_hits += index_->prefilter_contains(value);
+            }
+        }
+        counters_.lookup_seconds += seconds_since(prefilter_start);
+        counters_.num_lookups += num_sampled;
+        counters_.num_prefilter_checked += 1;
+
+        if (num_prefilter_hits < settings_.prefilter_min_hits or
+            num_prefilter_hits < settings_.prefilter_fraction * num_sampled)
+            return false;
+        prefilter_read.call_from_prefilter(result_->stats_model(), host_index_, num_sampled, num_prefilter_hits);
+        counters_.num_prefiltered += 1;
+        PLOG_VERBOSE << "Read " << prefilter_read.read_id() << " called from host prefilter";
+        report_called(prefilter_read, batch, i);
+        return true;
+    }
+
+    // Returns true if the read is called confidently from the triage index
+    bool triage(ReadEntry &triage_read, const std::vector<uint64_t> &minimisers, const ReadBatch<record_type> &batch,
+                const size_t i) {
+        const auto triage_start = std::chrono::steady_clock::now();
+        for (const auto &value: minimisers) {
+            if (index_->in_triage_sample(value))
+                triage_read.update_entry(triage_agent_.bulk_contains(value));
+        }
+        counters_.lookup_seconds += seconds_since(triage_start);
+        counters_.num_lookups += triage_read.num_hashes();
+        counters_.num_triaged += 1;
+
+        if (triage_read.num_hashes() > 0) {
+            triage_read.post_process(result_->input_summary());
+            // only the triage tier uses the dehost semantics for paired reads, see PipelineSettings::dehost
+            if (result_->confident_call(triage_read, settings_.triage_confidence, true)) {
+                PLOG_VERBOSE << "Read " << triage_read.read_id() << " called from triage index";
+                report(triage_read, batch, i, true);
+                return true;
+            }
+        }
+        counters_.num_second_tier += 1;
+        return false;
+    }
+
+    // Looks up the minimisers in chunks of early_stop, stopping once the sequential test can call the read
+    void lookup_until_called(ReadEntry &read, const std::vector<uint64_t> &minimisers) {
+        if (not test_.initialized())
+            test_ = SequentialTest(result_->stats_model(), result_->input_summary(),
+                                   result_->input_summary().host_category_index(), settings_.early_stop_error);
+        test_.reset();
+        for (size_t first = 0; first < minimisers.size(); first += settings_.early_stop) {
+            const auto count = std::min<size_t>(settings_.early_stop, minimisers.size() - first);
+            read.update_entries(agent_, std::span<const uint64_t>(minimisers).subspan(first, count));
+            if (test_.update(read.hits(), first)) {
+                if (first + count < minimisers.size())
+                    counters_.num_stopped_early += 1;
+                break;
+            }
+        }
+        // only reads which went through the sequential test, so other tiers do not count as used
+        counters_.num_minimisers += minimisers.size();
+        counters_.num_minimisers_used += read.num_hashes();
+    }
+
+    void process_read(const ReadBatch<record_type> &batch, const size_t i) {
+        const auto &record = batch.records[i];
+        if constexpr (paired)
+            check_mate_ids(record, batch.records2[i]);
+        const auto read_id = split(record.id(), " ")[0];
+        const uint64_t read_index = batch.first_index + i;
+
+        uint64_t read_length = 0;
+        uint64_t num_qualities = 0;
+        uint64_t sum = 0;
+        for_each_mate(batch, i, [&](const record_type &mate) {
+            read_length += std::ranges::size(mate.sequence());
+            auto qualities = mate.base_qualities() |
+                             std::views::transform([](auto quality) { return seqan3::to_phred(quality); });
+            sum = std::accumulate(qualities.begin(), qualities.end(), sum);
+            num_qualities += std::ranges::size(qualities);
+        });
+        if (read_length > std::numeric_limits<uint32_t>::max()) {
+            PLOG_WARNING << "Ignoring read " << record.id() << " as too long!";
+            result_->skip_read(read_index);
+            return;
+        }
+        if (read_length == 0) {
+            PLOG_WARNING << "Ignoring read " << record.id() << " as has zero length!";
+            result_->skip_read(read_index);
+            return;
+        }
+        float mean_quality = 0;
+        if (num_qualities > 0)
+            mean_quality = static_cast< float >( sum ) / static_cast< float >(num_qualities);
+        PLOG_VERBOSE << "Mean quality of read  " << record.id() << " is " << mean_quality;
+
+        const float compression_ratio = this->compression_ratio(batch, i);
+        PLOG_VERBOSE << "Found compression ratio of read  " << record.id() << " is " << compression_ratio;
+
+        // once the model is ready, reads which could never be called are reported without hashing or lookups
+        const bool model_ready = result_->model_ready();
+        if (model_ready) {
+            const auto reason = ReadEntry::filter_reason(result_->stats_model(), read_length, mean_quality,
+                                                         compression_ratio);
+            if (reason != nullptr) {
+                auto filtered_read = ReadEntry(read_id, read_index, read_length, mean_quality, compression_ratio,
+                                               result_->input_summary());
+                filtered_read.reject(reason);
+                counters_.num_filtered += 1;
+                counters_.num_filtered_bases += read_length;
+                PLOG_VERBOSE << "Read " << read_id << " rejected by " << reason << " filter";
+                report_called(filtered_read, batch, i);
+                return;
+            }
+        }
+
+        auto &minimisers = sort_queries_ ? chunk_minimisers_[i] : minimisers_;
+        const auto hash_start = std::chrono::steady_clock::now();
+        minimisers.clear();
+        for_each_mate(batch, i, [&](const record_type &mate) {
+            splitter_.compute(hasher_, mate.sequence(), minimisers);
+        });
+        if (subsampler_.apply(minimisers))
+            counters_.num_subsampled += 1;
+        counters_.lookup_seconds += seconds_since(hash_start);
+
+        if (settings_.prefilter and model_ready) {
+            auto prefilter_read = ReadEntry(read_id, read_index, read_length, mean_quality, compression_ratio,
+                                            result_->input_summary(), hits_);
+            if (prefilter(prefilter_read, minimisers, batch, i))
+                return;
+        }
+
+        if (settings_.cascade and model_ready) {
+            auto triage_read = ReadEntry(read_id, read_index, read_length, mean_quality, compression_ratio,
+                                         result_->input_summary(), triage_hits_);
+            if (triage(triage_read, minimisers, batch, i))
+                return;
+        }
+
+        auto read = ReadEntry(read_id, read_index, read_length, mean_quality, compression_ratio,
+                              result_->input_summary(), hits_);
+        if (sort_queries_) {
+            chunk_reads_[i] = std::move(read);
+            chunk_ready_[i] = 1;
+            return;
+        }
+        const auto lookup_start = std::chrono::steady_clock::now();
+        if (settings_.early_stop > 0 and model_ready)
+            lookup_until_called(read, minimisers);
+        else
+            splitter_.update_entries(agent_, read, minimisers, read_length, num_words_);
+        counters_.lookup_seconds += seconds_since(lookup_start);
+        counters_.num_lookups += read.num_hashes();
+        PLOG_VERBOSE << "Finished adding raw hash counts for read " << read_id;
+
+        read.post_process(result_->input_summary());
+        report(read, batch, i, settings_.dehost);
+    }
+
+public:
+    ReadClassifier() = default;
+
+    ReadClassifier(ReadClassifier const &) = default;
+
+    ReadClassifier(ReadClassifier &&) = default;
+
+    ReadClassifier &operator=(ReadClassifier const &) = default;
+
+    ReadClassifier &operator=(ReadClassifier &&) = default;
+
+    ~ReadClassifier() = default;
+
+    template<typename arguments_t>
+    ReadClassifier(const arguments_t &opt, const IndexSet &index, Result<record_type> &result,
+                   const PipelineSettings &settings) :
+            index_(&index),
+            result_(&result),
+            settings_(settings),
+            sort_queries_(opt.sort_queries),
+            gzip_complexity_(opt.complexity == "gzip"),
+            num_words_((index.num_bins() + 63) / 64),
+            host_index_(settings.prefilter ? index.summary().host_category_index() : 0),
+            agent_(index.agent()),
+            triage_agent_(settings.cascade ? index.triage_agent() : IndexSetAgent()),
+            hasher_(index.kmer_size(), index.window_size()),
+            subsampler_(opt.max_minimisers, opt.subsample == "hash"),
+            splitter_(opt.split_length) {}
+
+    std::string kernel_name() const {
+        return hasher_.name();
+    }
+
+    std::string layout_name() const {
+        return agent_.layout_name();
+    }
+
+    const PipelineCounters &counters() const {
+        return counters_;
+    }
+
+    // Time spent processing batches, the rest of the time the thread waited for work
+    double busy_seconds() const {
+        return busy_seconds_;
+    }
+
+    void process(const ReadBatch<record_type> &batch) {
+        const auto batch_start = std::chrono::steady_clock::now();
+        const auto num_reads = batch.records.size();
+        if (sort_queries_) {
+            chunk_minimisers_.resize(num_reads);
+            for (auto &values: chunk_minimisers_)
+                values.clear();
+            chunk_reads_.assign(num_reads, ReadEntry());
+            chunk_ready_.assign(num_reads, 0);
+        }
+
+        for (size_t i = 0; i < num_reads; ++i)
+            process_read(batch, i);
+
+        if (sort_queries_) {
+            const auto lookup_start = std::chrono::steady_clock::now();
+            chunk_query_.run(agent_, chunk_minimisers_, num_words_);
+            counters_.lookup_seconds += seconds_since(lookup_start);
+            counters_.num_lookups += chunk_query_.num_rows();
+
+            for (size_t i = 0; i < num_reads; ++i) {
+                if (not chunk_ready_[i])
+                    continue;
+                auto &read = chunk_reads_[i];
+                read.post_process(result_->input_summary(), chunk_query_.view(i));
+                report(read, batch, i, settings_.dehost);
+            }
+        }
+        busy_seconds_ += seconds_since(batch_start);
+    }
+};
+
+// Classifies the reads of opt.read_file, or the pairs of opt.read_file and opt.read_file2, against the index and
+// writes the results. The input is parsed on its own thread while each worker takes batches of reads from the queue
+// and runs them through its own ReadClassifier, so neither waits for the other at the end of each chunk.
+template<bool paired, typename arguments_t>
+void classify_input(const arguments_t &opt, const IndexSet &index, const PipelineSettings &settings) {
+    // gzipped input is decompressed on separate threads, in parallel for BGZF
+    auto input1 = DecompressedInput(opt.read_file, opt.decompression_threads);
+    auto fin1 = input1.open();
+    using record_type = decltype(fin1)::record_type;
+    std::unique_ptr<DecompressedInput> input2;
+    std::unique_ptr<FastxReader> fin2;
+    if constexpr (paired) {
+        input2 = std::make_unique<DecompressedInput>(opt.read_file2, opt.decompression_threads);
+        fin2 = std::make_unique<FastxReader>(input2->stream());
+    }
+
+    auto result = Result<record_type>(opt, index.summary());
+    PLOG_DEBUG << "Defined Result with " << +index.num_bins() << " bins";
+
+    auto classifier = ReadClassifier<record_type, paired>(opt, index, result, settings);
+    PLOG_INFO << "Using the " << classifier.kernel_name() << " minimiser kernel";
+
+    PipelineCounters counters;
+    std::vector<double> thread_busy_seconds(opt.threads, 0); // time each worker spent on batches, the rest is idle
+    const auto pool_start = std::chrono::steady_clock::now();
+    auto reader = paired ? ReadBatchReader(fin1, *fin2, opt.chunk_size, opt.batch_bases, 2 * opt.threads)
+                         : ReadBatchReader(fin1, opt.chunk_size, opt.batch_bases, 2 * opt.threads);
+#pragma omp parallel firstprivate(classifier) num_threads(opt.threads) shared(reader, counters, thread_busy_seconds)
+    {
+        ReadBatch<record_type> batch;
+        while (reader.next(batch))
+            classifier.process(batch);
+        thread_busy_seconds[omp_get_thread_num()] = classifier.busy_seconds();
+#pragma omp critical(merge_counters)
+        counters.add(classifier.counters());
+    }
+    reader.finish();
+    input1.close();
+    if constexpr (paired)
+        input2->close();
+    log_thread_utilisation(thread_busy_seconds,
+                           std::chrono::duration<double>(std::chrono::steady_clock::now() - pool_start).count());
+    result.complete(settings.dehost);
+    result.print_summary();
+    log_lookup_rate(classifier.layout_name(), counters.num_lookups, counters.lookup_seconds);
+    log_subsample_summary(counters.num_subsampled, opt.max_minimisers);
+    log_filter_summary(counters.num_filtered, counters.num_filtered_bases, counters.num_lookups, index.kmer_size(),
+                       index.window_size());
+    log_prefilter_summary(counters.num_prefilter_checked, counters.num_prefiltered);
+    log_cascade_summary(counters.num_triaged, counters.num_second_tier);
+    if (settings.early_stop > 0)
+        log_early_stop_summary(counters.num_minimisers, counters.num_minimisers_used, counters.num_stopped_early);
+}
+
+#endif // CHARON_READ_CLASSIFIER_H
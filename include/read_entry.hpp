@@ -5,10 +5,16 @@
 
 #include <string>
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <span>
 
 #include <plog/Log.h>
 
 #include <counts.hpp>
+#include <hit_kernels.hpp>
+#include <hit_matrix.hpp>
 #include <input_summary.hpp>
 #include <classify_stats.hpp>
 
@@ -16,13 +22,13 @@
 class ReadEntry {
 private:
     std::string read_id_;
+    uint64_t read_index_{0}; // position of the read in the input
     uint32_t length_;
     float mean_quality_;
     float compression_;
 
     uint32_t num_hashes_{0};
-    std::vector<seqan3::interleaved_bloom_filter<seqan3::compressed>::membership_agent_type::binning_bitvector> bits_;// this collects over all bins
-    std::unordered_map<uint8_t, std::vector<bool>> max_bits_; // this summarizes over categories (which may have multiple bins)
+    HitMatrix *hits_{nullptr}; // per-thread storage for the hits of each hash, only valid until post_process
     std::vector<uint32_t> counts_;
     std::vector<uint32_t> unique_counts_;
     std::vector<float> proportions_; // this collects over categories the proportion of all hashes which were from the given category
@@ -30,6 +36,18 @@ private:
     std::vector<double> probabilities_; // this collects over categories the probability of this read given the data come from that category
     uint8_t call_ = std::numeric_limits<uint8_t>::max();
     uint8_t confidence_score_ = 0;
+    const char *filter_reason_{nullptr}; // set if the read was rejected by the filters before any lookups
+
+    template<typename number_t>
+    static void append_number(std::string &out, const number_t value) {
+        std::array<char, 32> buffer;
+        std::to_chars_result result;
+        if constexpr (std::is_floating_point_v<number_t>)
+            result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value, std::chars_format::general, 6);
+        else
+            result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+        out.append(buffer.data(), result.ptr);
+    }
 public:
     ReadEntry() = default;
 
@@ -43,30 +61,73 @@ public:
 
     ~ReadEntry() = default;
 
-    ReadEntry(const std::string &read_id, const uint32_t &length, const float &mean_quality, const float &compression,
-              const InputSummary &summary) :
+    ReadEntry(const std::string &read_id, const uint64_t &read_index, const uint32_t &length, const float &mean_quality,
+              const float &compression, const InputSummary &summary, HitMatrix &hits) :
             read_id_(read_id),
+            read_index_(read_index),
             length_(length),
             mean_quality_(mean_quality),
             compression_(compression),
+            hits_(&hits),
             counts_(summary.num_categories(), 0),
             proportions_(summary.num_categories(), 0),
             unique_proportions_(summary.num_categories(), 0),
             unique_counts_(summary.num_categories(), 0),
             probabilities_(summary.num_categories(), 1) {
         PLOG_DEBUG << "Initialize entry with read_id " << read_id << " and length " << length;
-        bits_.reserve(length);
-
-        for (auto i = 0; i < summary.num_categories(); ++i) {
-            max_bits_[i].reserve(length);
-        }
+        hits_->reset((summary.num_bins + 63) / 64, length);
         PLOG_VERBOSE << "Initializing complete for read_id " << read_id;
     }
 
+    // For a read which is not queried against the index, e.g. as it fails the filters
+    ReadEntry(const std::string &read_id, const uint64_t &read_index, const uint32_t &length, const float &mean_quality,
+              const float &compression, const InputSummary &summary) :
+            read_id_(read_id),
+            read_index_(read_index),
+            length_(length),
+            mean_quality_(mean_quality),
+            compression_(compression),
+            counts_(summary.num_categories(), 0),
+            proportions_(summary.num_categories(), 0),
+            unique_proportions_(summary.num_categories(), 0),
+            unique_counts_(summary.num_categories(), 0),
+            probabilities_(summary.num_categories(), 0) {}
+
+    // The first of the quality, length and compression filters which the read fails, or nullptr if it passes them.
+    // A read failing any of them is never called, whatever its hits.
+    static const char *filter_reason(const StatsModel &stats_model, const uint32_t length, const float mean_quality,
+                                     const float compression) {
+        if (mean_quality < stats_model.min_quality())
+            return "quality";
+        if (length < stats_model.min_length())
+            return "length";
+        if (compression < stats_model.min_compression())
+            return "compression";
+        return nullptr;
+    }
+
+    // Leave the read unclassified without querying the index, recording why
+    void reject(const char *reason) {
+        filter_reason_ = reason;
+        call_ = std::numeric_limits<uint8_t>::max();
+    }
+
+    const char *filter_reason() const {
+        return filter_reason_;
+    }
+
     const std::string &read_id() const {
         return read_id_;
     }
 
+    uint64_t read_index() const {
+        return read_index_;
+    }
+
+    uint32_t num_hashes() const {
+        return num_hashes_;
+    }
+
     const std::vector<float> &proportions() const {
         return proportions_;
     }
@@ -83,25 +144,46 @@ public:
         return confidence_score_;
     }
 
-    void update_entry(const auto &entry) {
-        // this "entry" is a bitvector with a 1 or 0 for each bin in the ibf
-        bits_.emplace_back(entry);
+    void update_entry(const uint64_t *entry) {
+        // this "entry" is a bitvector with a 1 or 0 for each bin in the ibf, packed into words
+        hits_->append(entry);
         num_hashes_ += 1;
     };
 
-    void get_counts(const InputSummary &summary) {
+    // Append rows already looked up, e.g. for a segment of the read
+    void append_entries(const HitMatrixView &rows) {
+        for (uint32_t i = 0; i < rows.num_rows; ++i)
+            hits_->append(rows.row(i));
+        num_hashes_ += rows.num_rows;
+    }
+
+    // The hits added so far, only valid before post_process
+    HitMatrixView hits() const {
+        assert(hits_ != nullptr);
+        return hits_->view();
+    }
+
+    // Look up all the values at once with an agent supporting batched lookups
+    template<typename agent_t>
+    void update_entries(agent_t &agent, std::span<const uint64_t> values) {
+        agent.bulk_contains(values, *hits_);
+        num_hashes_ += values.size();
+    };
+
+    void get_counts(const InputSummary &summary, const HitMatrixView &hits) {
         PLOG_DEBUG << "Get max bits per category for read " << read_id_;
+        assert(hits.num_rows == num_hashes_);
 
         // get totals in each bin
-        seqan3::counting_vector<uint64_t> total_bits_per_bin(summary.num_bins, 0);
-        for (const auto &entry: bits_) {
-            total_bits_per_bin += entry;
-        }
-        PLOG_DEBUG << "Have the following total hits per bin: " << total_bits_per_bin;
+        std::array<uint32_t, std::numeric_limits<uint8_t>::max() + 1> total_bits_per_bin{};
+        assert(hits.num_words * 64 <= total_bits_per_bin.size());
+        count_bin_hits(hits, total_bits_per_bin.data());
 
         // identify max bin per category
-        std::vector<uint8_t> index_per_category(summary.num_categories(), std::numeric_limits<uint8_t>::max());
-        for (auto bin = 0; bin < total_bits_per_bin.size(); ++bin) {
+        std::array<uint8_t, std::numeric_limits<uint8_t>::max() + 1> index_per_category{};
+        const auto num_categories = summary.num_categories();
+        std::fill_n(index_per_category.begin(), num_categories, std::numeric_limits<uint8_t>::max());
+        for (auto bin = 0; bin < summary.num_bins; ++bin) {
             const auto &bits_in_bin = total_bits_per_bin[bin];
             const auto &category = summary.bin_to_category.at(bin);
             const auto &index = summary.category_index(category);
@@ -113,27 +195,8 @@ public:
             }
         }
 
-        //
-        for (auto category = 0; category < summary.num_categories(); ++category) {
-            max_bits_.at(category).resize(num_hashes_);
-        }
-
-        // collect together the bitvector for max bits and the unique_counts
-        std::vector<uint8_t> found;
-        for (const auto &entry: bits_) {
-            found.clear();
-            for (auto category = 0; category < index_per_category.size(); ++category) {
-                const auto &category_index = index_per_category[category];
-                max_bits_.at(category).emplace_back(entry[category_index]);
-                if (entry[category_index] == 1) {
-                    found.push_back(category);
-                }
-            }
-            if (found.size() == 1) {
-                auto i = found.front();
-                unique_counts_.at(i) += 1;
-            }
-        }
+        // collect the unique_counts from the max bin of each category
+        count_unique_category_hits(hits, index_per_category.data(), num_categories, unique_counts_.data());
         PLOG_DEBUG << "Found unique counts " << unique_counts_;
     };
 
@@ -150,8 +213,16 @@ public:
     }
 
     void post_process(const InputSummary &summary) {
-        get_counts(summary);
+        assert(hits_ != nullptr);
+        post_process(summary, hits_->view());
+    }
+
+    // Post process using hits looked up elsewhere, one row per hash of the read
+    void post_process(const InputSummary &summary, const HitMatrixView &hits) {
+        num_hashes_ = hits.num_rows;
+        get_counts(summary, hits);
         get_proportions();
+        hits_ = nullptr; // the hit matrix is reused for the next read
     }
 
     void call_category(const StatsModel &stats_model) {
@@ -268,13 +339,32 @@ public:
             call_ = other_index;
     }
 
+    // Call the read as host without querying the index, as num_hits of the num_sampled minimisers checked against the
+    // host prefilter were found in it. The read still has to pass the quality, length and compression filters.
+    void call_from_prefilter(const StatsModel &stats_model, const uint8_t host_index, const uint32_t num_sampled,
+                             const uint32_t num_hits) {
+        num_hashes_ = num_sampled;
+        counts_.at(host_index) = num_hits;
+        unique_counts_.at(host_index) = num_hits;
+        get_proportions();
+        std::fill(probabilities_.begin(), probabilities_.end(), 0);
+        probabilities_.at(host_index) = 1;
+        confidence_score_ = static_cast<uint8_t>(std::min<uint32_t>(num_hits, std::numeric_limits<uint8_t>::max()));
+        hits_ = nullptr;
+
+        if (mean_quality_ < stats_model.min_quality() or length_ < stats_model.min_length() or
+            compression_ < stats_model.min_compression())
+            return;
+        call_ = host_index;
+    }
+
     void apply_model(const StatsModel &stats_model) {
         for (auto i = 0; i < unique_proportions_.size(); ++i) {
             const auto &read_proportion = unique_proportions_.at(i);
             const auto result_pair = stats_model.classify(i, read_proportion);
             PLOG_DEBUG << "Pos " << +i << " has read proportion " << read_proportion << " yielding probs "
                        << result_pair.pos << " and " << result_pair.neg << " for read " << read_id_;
-            probabilities_.at(i) *= result_pair.pos;
+            probabilities_.at(i) = result_pair.pos;
         }
     }
 
@@ -308,32 +398,48 @@ public:
             }
             std::cout << "\t";
         }*/
-        for (auto i = 0; i < summary.num_categories(); i++) {
-            //const auto & category = summary.categories.at(i);
-            const auto &bitvector = max_bits_.at(i);
-            for (auto j = 0; j < bitvector.size(); j++) {
-                std::cout << +bitvector.at(j);
-            }
-            std::cout << "\t";
-        }
         std::cout << std::endl;
     };
 
-    void print_assignment_result(const InputSummary &summary) const {
+    void format_assignment_result(const InputSummary &summary, std::string &out) const {
         // mimic the kraken assignment format with tab separated columns classification status, read_id, call, length, num_hashes, details
+        // numbers are written as std::ostream would with its default precision of 6
         if (call_ == std::numeric_limits<uint8_t>::max())
-            std::cout << "U" << "\t";
+            out += "U\t";
         else
-            std::cout << "C" << "\t";
-        std::cout.precision(6);
-        std::cout << read_id_ << "\t" << summary.category_name(call_) << "\t" << length_ << "\t" << num_hashes_ << "\t"
-                  << mean_quality_ << "\t" << +confidence_score_ << "\t" << compression_ << "\t";
+            out += "C\t";
+        out += read_id_;
+        out += '\t';
+        out += summary.category_name(call_);
+        out += '\t';
+        append_number(out, length_);
+        out += '\t';
+        append_number(out, num_hashes_);
+        out += '\t';
+        append_number(out, mean_quality_);
+        out += '\t';
+        append_number(out, +confidence_score_);
+        out += '\t';
+        append_number(out, compression_);
+        out += '\t';
         for (auto i = 0; i < summary.num_categories(); i++) {
-            std::cout << summary.categories.at(i) << ":" << counts_.at(i) << ":" << proportions_.at(i)
-                      << ":" << unique_proportions_.at(i) << ":" << probabilities_.at(i) << " ";
+            out += summary.categories.at(i);
+            out += ':';
+            append_number(out, counts_.at(i));
+            out += ':';
+            append_number(out, proportions_.at(i));
+            out += ':';
+            append_number(out, unique_proportions_.at(i));
+            out += ':';
+            append_number(out, probabilities_.at(i));
+            out += ' ';
         }
-
-        std::cout << std::endl;
+        if (filter_reason_ != nullptr) {
+            out += "filtered:";
+            out += filter_reason_;
+            out += ' ';
+        }
+        out += '\n';
     };
 };
 
@@ -0,0 +1,168 @@
+#ifndef CHARON_READ_PIPELINE_H
+#define CHARON_READ_PIPELINE_H
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <ranges>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A queue holding at most capacity items, where push waits while it is full and pop waits while it is empty
+template<typename item_t>
+class BoundedQueue {
+private:
+    size_t capacity_{1};
+    std::deque<item_t> items_{};
+    bool closed_{false};
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+
+public:
+    explicit BoundedQueue(const size_t capacity) :
+            capacity_(std::max<size_t>(capacity, 1)) {}
+
+    BoundedQueue(BoundedQueue const &) = delete;
+
+    BoundedQueue &operator=(BoundedQueue const &) = delete;
+
+    void push(item_t &&item) {
+        {
+            std::unique_lock lock(mutex_);
+            not_full_.wait(lock, [this] { return items_.size() < capacity_; });
+            items_.push_back(std::move(item));
+        }
+        not_empty_.notify_one();
+    }
+
+    // Returns false once the queue is closed and empty
+    bool pop(item_t &item) {
+        {
+            std::unique_lock lock(mutex_);
+            not_empty_.wait(lock, [this] { return closed_ or not items_.empty(); });
+            if (items_.empty())
+                return false;
+            item = std::move(items_.front());
+            items_.pop_front();
+        }
+        not_full_.notify_one();
+        return true;
+    }
+
+    // No more items will be pushed
+    void close() {
+        {
+            std::unique_lock lock(mutex_);
+            closed_ = true;
+        }
+        not_empty_.notify_all();
+    }
+};
+
+// Consecutive records from the input, with the mates of paired reads in records2
+template<typename record_type>
+struct ReadBatch {
+    uint64_t first_index{0}; // index in the input of the first record
+    std::vector<record_type> records{};
+    std::vector<record_type> records2{};
+};
+
+// Parses the read file(s) on a separate thread into batches of batch_size records, so that reading and decompressing
+// the input overlaps with processing the reads. At most queue_size batches wait to be processed, so the reader stops
+// when the workers fall behind and memory stays bounded.
+//
+// As the cost of a read grows with its length, a batch is also ended once its reads add up to max_bases (of the first
+// mate for paired reads). With read lengths varying over orders of magnitude, e.g. nanopore, a batch of long reads is
+// then about as much work as a batch of short reads, and a very long read gets a batch of its own rather than holding
+// back the reads batched with it.
+template<typename file_t>
+class ReadBatchReader {
+public:
+    using record_type = typename file_t::record_type;
+
+private:
+    BoundedQueue<ReadBatch<record_type>> queue_;
+    std::thread thread_;
+    std::exception_ptr error_{nullptr};
+
+    void run(file_t &fin, file_t *fin2, const uint32_t batch_size, const uint64_t max_bases) {
+        try {
+            uint64_t num_records = 0;
+            uint64_t num_bases = 0;
+            ReadBatch<record_type> batch;
+            batch.records.reserve(batch_size);
+
+            auto push_batch = [&]() {
+                if (fin2 != nullptr) {
+                    // read the same number of mates from the second file
+                    for (auto &record2: *fin2 | std::views::take(batch.records.size()))
+                        batch.records2.push_back(std::move(record2));
+                }
+                num_records += batch.records.size();
+                queue_.push(std::move(batch));
+                batch = ReadBatch<record_type>();
+                batch.first_index = num_records;
+                batch.records.reserve(batch_size);
+                num_bases = 0;
+            };
+
+            for (auto &record: fin) {
+                num_bases += std::ranges::size(record.sequence());
+                batch.records.push_back(std::move(record));
+                if (batch.records.size() == batch_size or num_bases >= max_bases)
+                    push_batch();
+            }
+            if (not batch.records.empty())
+                push_batch();
+        } catch (...) {
+            error_ = std::current_exception();
+        }
+        queue_.close();
+    }
+
+public:
+    ReadBatchReader(file_t &fin, const uint32_t batch_size, const uint64_t max_bases, const size_t queue_size) :
+            queue_(queue_size) {
+        thread_ = std::thread(&ReadBatchReader::run, this, std::ref(fin), nullptr, std::max<uint32_t>(batch_size, 1),
+                              max_bases);
+    }
+
+    // For paired reads, with the mates in fin2 in the same order
+    ReadBatchReader(file_t &fin1, file_t &fin2, const uint32_t batch_size, const uint64_t max_bases,
+                    const size_t queue_size) :
+            queue_(queue_size) {
+        thread_ = std::thread(&ReadBatchReader::run, this, std::ref(fin1), &fin2, std::max<uint32_t>(batch_size, 1),
+                              max_bases);
+    }
+
+    ReadBatchReader(ReadBatchReader const &) = delete;
+
+    ReadBatchReader &operator=(ReadBatchReader const &) = delete;
+
+    ~ReadBatchReader() {
+        if (thread_.joinable())
+            thread_.join();
+    }
+
+    // Waits for the next batch, returns false once all records have been read
+    bool next(ReadBatch<record_type> &batch) {
+        return queue_.pop(batch);
+    }
+
+    // Waits for the reader to finish, rethrowing any error it hit reading the input
+    void finish() {
+        if (thread_.joinable())
+            thread_.join();
+        if (error_)
+            std::rethrow_exception(error_);
+    }
+};
+
+#endif // CHARON_READ_PIPELINE_H
@@ -3,25 +3,43 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <limits>
+#include <memory>
 #include <string>
 
+#include <omp.h>
+
 #include <seqan3/search/dream_index/interleaved_bloom_filter.hpp>
-#include <seqan3/io/sequence_file/output.hpp>
 #include <utility>
 #include <plog/Log.h>
 
+#include "extract_writer.hpp"
+#include "output_writer.hpp"
 #include "read_entry.hpp"
 #include "dehost_arguments.hpp"
 #include "input_summary.hpp"
 #include "classify_stats.hpp"
 
-struct ResultSummary {
-    std::vector<uint64_t> classified_counts;
+// Counts of one thread. The counts are held inline (a call is below 255, as 255 means unclassified) rather than in a
+// separate allocation, and the struct is aligned to a cache line, so the summaries of different threads never share
+// cache lines.
+struct alignas(64) ResultSummary {
+    std::array<uint64_t, std::numeric_limits<uint8_t>::max()> classified_counts{};
     uint64_t unclassified_count{0};
     uint64_t extracted_count{0};
+    uint8_t num_categories{0};
 
     ResultSummary(const uint8_t size) :
-            classified_counts(size, 0) {};
+            num_categories{size} {};
+
+    void add(const ResultSummary &other) {
+        for (auto i = 0; i < num_categories; ++i)
+            classified_counts[i] += other.classified_counts[i];
+        unclassified_count += other.unclassified_count;
+        extracted_count += other.extracted_count;
+    }
 };
 
 template<class record_type>
@@ -32,16 +50,41 @@ struct ReadRecord {
     record_type record2;
 };
 
-template<class record_type, class outfile_field_ids, class outfile_format>
+template<class record_type>
 class Result {
 private:
     InputSummary input_summary_;
-    ResultSummary result_summary_;
+    std::vector<ResultSummary> thread_summaries_; // counts for each thread, combined in print_summary
     StatsModel stats_model_;
     std::vector<ReadRecord<record_type>> cached_reads_;
+    std::atomic<bool> model_ready_{false}; // set once training is complete, so can be read without add_to_cache
+
+    std::unique_ptr<AssignmentWriter> writer_;
 
     bool run_extract_;
-    std::unordered_map<uint8_t, std::vector<seqan3::sequence_file_output<outfile_field_ids, outfile_format>>> extract_handles_;
+    std::unique_ptr<ExtractWriter> extract_writer_;
+    std::unordered_map<uint8_t, size_t> extract_outputs_; // index in extract_writer_ of the output of each category
+
+    // Adds the read to the training data and the cache of reads to classify once the model is trained. Must be called
+    // within critical(add_to_cache). Returns false if training completed while waiting for the lock, in which case the
+    // read should be classified as usual.
+    bool cache_read(ReadRecord<record_type> &&read_record, const bool dehost) {
+        if (model_ready())
+            return false;
+        PLOG_VERBOSE << "Add read " << read_record.read.read_id() << " to training ";
+        bool training_complete = false;
+        if (cached_reads_.size() < cached_reads_.capacity()) {
+            training_complete = stats_model_.add_read_to_training_data(read_record.read.unique_proportions());
+            cached_reads_.emplace_back(std::move(read_record));
+        } else {
+            stats_model_.force_ready();
+            training_complete = true;
+        }
+
+        if (training_complete)
+            classify_cache(dehost);
+        return true;
+    }
 
 public:
     Result() = default;
@@ -58,32 +101,46 @@ public:
 
     Result(const ClassifyArguments &opt, const InputSummary &summary) :
             input_summary_{summary},
-            result_summary_(summary.num_categories()),
+            thread_summaries_(std::max<int>(opt.threads, 1), ResultSummary(summary.num_categories())),
             run_extract_(opt.run_extract) {
         stats_model_ = StatsModel(opt, summary);
         if (opt.run_extract) {
-            for (const auto [category_index, extract_files]: opt.extract_category_to_file) {
-                for (const auto extract_file: extract_files)
-                    extract_handles_[category_index].push_back(seqan3::sequence_file_output{extract_file});
+            extract_writer_ = std::make_unique<ExtractWriter>(opt.compression_level, opt.threads);
+            for (const auto &[category_index, extract_files]: opt.extract_category_to_file) {
+                extract_outputs_[category_index] = extract_writer_->add_output(
+                        std::vector<std::string>(extract_files.begin(), extract_files.end()));
                 cached_reads_.reserve(opt.num_reads_to_fit * summary.num_categories() * 4);
             }
+            extract_writer_->start();
         }
+        // reads cached for training are written once the model is trained, so the reorder buffer must hold at least
+        // as many reads as the cache plus those in flight (up to 2 batches queued per thread and 1 being processed)
+        const uint64_t max_in_flight = 3 * static_cast<uint64_t>(std::max<uint8_t>(opt.threads, 1)) * opt.chunk_size;
+        writer_ = std::make_unique<AssignmentWriter>(opt.output, opt.ordered, opt.threads,
+                                                     cached_reads_.capacity() + max_in_flight + (1 << 16));
 
 
     };
 
     Result(const DehostArguments &opt, const InputSummary &summary) :
             input_summary_{summary},
-            result_summary_(summary.num_categories()),
+            thread_summaries_(std::max<int>(opt.threads, 1), ResultSummary(summary.num_categories())),
             run_extract_(opt.run_extract) {
         stats_model_ = StatsModel(opt, summary);
         if (opt.run_extract) {
-            for (const auto [category_index, extract_files]: opt.extract_category_to_file) {
-                for (const auto extract_file: extract_files)
-                    extract_handles_[category_index].push_back(seqan3::sequence_file_output{extract_file});
+            extract_writer_ = std::make_unique<ExtractWriter>(opt.compression_level, opt.threads);
+            for (const auto &[category_index, extract_files]: opt.extract_category_to_file) {
+                extract_outputs_[category_index] = extract_writer_->add_output(
+                        std::vector<std::string>(extract_files.begin(), extract_files.end()));
                 cached_reads_.reserve(opt.num_reads_to_fit * summary.num_categories() * 4);
             }
+            extract_writer_->start();
         }
+        // reads cached for training are written once the model is trained, so the reorder buffer must hold at least
+        // as many reads as the cache plus those in flight (up to 2 batches queued per thread and 1 being processed)
+        const uint64_t max_in_flight = 3 * static_cast<uint64_t>(std::max<uint8_t>(opt.threads, 1)) * opt.chunk_size;
+        writer_ = std::make_unique<AssignmentWriter>(opt.output, opt.ordered, opt.threads,
+                                                     cached_reads_.capacity() + max_in_flight + (1 << 16));
     };
 
     const InputSummary &input_summary() const {
@@ -94,87 +151,108 @@ public:
         return input_summary_.category_index(category);
     }
 
+    const StatsModel &stats_model() const {
+        return stats_model_;
+    }
+
+    bool model_ready() const {
+        return model_ready_.load(std::memory_order_acquire);
+    }
+
+    // Makes a call for the read without recording it, returning true if a category was called with at least
+    // min_confidence. Only meaningful once the model is ready.
+    bool confident_call(ReadEntry &read_entry, const uint8_t min_confidence, const bool dehost = false) const {
+        if (not model_ready())
+            return false;
+        if (dehost)
+            read_entry.dehost(stats_model_, input_summary_.host_category_index());
+        else
+            read_entry.classify(stats_model_);
+        return read_entry.call() < std::numeric_limits<uint8_t>::max() and
+               read_entry.confidence_score() >= min_confidence;
+    }
+
     uint8_t classify_read(ReadEntry &read_entry, const bool dehost = false) {
         PLOG_VERBOSE << "Classify read " << read_entry.read_id();
         if (dehost)
             read_entry.dehost(stats_model_, input_summary_.host_category_index());
         else
             read_entry.classify(stats_model_);
-#pragma omp critical(print_result)
-        read_entry.print_assignment_result(input_summary_);
-#pragma omp critical(update_result_count)
-        {
-            const auto &call = read_entry.call();
-            if (call < std::numeric_limits<uint8_t>::max()) {
-                result_summary_.classified_counts[call] += 1;
-            } else {
-                result_summary_.unclassified_count += 1;
-            }
+        return report_read(read_entry);
+    }
+
+    // Print and count a read which already has its call. The line is formatted by the calling thread and written by
+    // the writer thread, and the counts are kept per thread.
+    uint8_t report_read(const ReadEntry &read_entry) {
+        writer_->add(read_entry.read_index(), [&](std::string &out) {
+            read_entry.format_assignment_result(input_summary_, out);
+        });
+
+        auto &summary = thread_summaries_.at(omp_get_thread_num());
+        const auto &call = read_entry.call();
+        if (call < std::numeric_limits<uint8_t>::max()) {
+            summary.classified_counts[call] += 1;
+        } else {
+            summary.unclassified_count += 1;
         }
         return read_entry.call();
 
     }
 
+    // Record that the read at read_index is not reported, e.g. as it has zero length
+    void skip_read(const uint64_t read_index) {
+        writer_->skip(read_index);
+    }
+
     void extract_read(const uint8_t category_index, const record_type &record) {
-#pragma omp critical(extract_read)
-        extract_handles_[category_index][0].push_back(record);
+        extract_writer_->add(extract_outputs_.at(category_index), record);
     }
 
     void extract_paired_read(const uint8_t category_index, const record_type &record, const record_type &record2) {
-#pragma omp critical(extract_read)
-        extract_handles_[category_index][0].push_back(record);
-#pragma omp critical(extract_read2)
-        extract_handles_[category_index][1].push_back(record2);
+        extract_writer_->add_pair(extract_outputs_.at(category_index), record, record2);
     }
 
     void add_read(ReadEntry &read_entry, const record_type &record, bool dehost = false) {
-        if (stats_model_.ready()) {
-            auto category_index = classify_read(read_entry, dehost);
-            if (run_extract_ and extract_handles_.find(category_index) != extract_handles_.end()) {
-                extract_read(category_index, record);
-            }
-        } else {
-            PLOG_VERBOSE << "Add read " << read_entry.read_id() << " to training ";
+        if (not model_ready()) {
+            bool cached = false;
 #pragma omp critical(add_to_cache)
-            {
-                bool training_complete = false;
-                if (cached_reads_.size() < cached_reads_.capacity()) {
-                    cached_reads_.emplace_back(ReadRecord(false, read_entry, record, record));
-                    training_complete = stats_model_.add_read_to_training_data(read_entry.unique_proportions());
-                } else {
-                    stats_model_.force_ready();
-                    training_complete = true;
-                }
-
-                if (training_complete)
-                    classify_cache(dehost);
-            }
+            cached = cache_read(ReadRecord(false, read_entry, record, record), dehost);
+            if (cached)
+                return;
         }
+        auto category_index = classify_read(read_entry, dehost);
+        if (run_extract_ and extract_outputs_.find(category_index) != extract_outputs_.end()) {
+            extract_read(category_index, record);
+        }
+    }
+
+    // Add a read called without the model (e.g. by the host prefilter), only once the model is ready
+    void add_called_read(const ReadEntry &read_entry, const record_type &record) {
+        assert(model_ready());
+        auto category_index = report_read(read_entry);
+        if (run_extract_ and extract_outputs_.find(category_index) != extract_outputs_.end())
+            extract_read(category_index, record);
+    }
+
+    void add_called_paired_read(const ReadEntry &read_entry, const record_type &record, const record_type &record2) {
+        assert(model_ready());
+        auto category_index = report_read(read_entry);
+        if (run_extract_ and extract_outputs_.find(category_index) != extract_outputs_.end())
+            extract_paired_read(category_index, record, record2);
     }
 
     void add_paired_read(ReadEntry &read_entry, const record_type &record, const record_type &record2,
                          const bool dehost = false) {
-        if (stats_model_.ready()) {
-            auto category_index = classify_read(read_entry, dehost);
-            if (run_extract_ and extract_handles_.find(category_index) != extract_handles_.end()) {
-                extract_paired_read(category_index, record, record2);
-            }
-        } else {
-            PLOG_VERBOSE << "Add read " << read_entry.read_id() << " to training ";
+        if (not model_ready()) {
+            bool cached = false;
 #pragma omp critical(add_to_cache)
-            {
-                bool training_complete = false;
-                if (cached_reads_.size() < cached_reads_.capacity()) {
-                    cached_reads_.emplace_back(ReadRecord(true, read_entry, record, record2));
-                    training_complete = stats_model_.add_read_to_training_data(read_entry.unique_proportions());
-                } else {
-                    stats_model_.force_ready();
-                    training_complete = true;
-                }
-
-                if (training_complete)
-                    classify_cache(dehost);
-            }
+            cached = cache_read(ReadRecord(true, read_entry, record, record2), dehost);
+            if (cached)
+                return;
+        }
+        auto category_index = classify_read(read_entry, dehost);
+        if (run_extract_ and extract_outputs_.find(category_index) != extract_outputs_.end()) {
+            extract_paired_read(category_index, record, record2);
         }
     }
 
@@ -185,7 +263,7 @@ public:
             auto &read_entry = read_record.read;
             const auto &record = read_record.record;
             auto category_index = classify_read(read_entry, dehost);
-            if (run_extract_ and extract_handles_.find(category_index) != extract_handles_.end()) {
+            if (run_extract_ and extract_outputs_.find(category_index) != extract_outputs_.end()) {
                 if (read_record.is_paired) {
                     const auto &record2 = read_record.record2;
                     extract_paired_read(category_index, record, record2);
@@ -195,21 +273,29 @@ public:
             }
         }
         cached_reads_.resize(0);
+        model_ready_.store(stats_model_.ready(), std::memory_order_release);
     }
 
     void complete(const bool dehost = false) {
         classify_cache(dehost);
+        writer_->close();
+        if (extract_writer_)
+            extract_writer_->close();
     }
 
 
     void print_summary() const {
 
+        auto result_summary = ResultSummary(input_summary_.num_categories());
+        for (const auto &summary: thread_summaries_)
+            result_summary.add(summary);
+
         PLOG_INFO << "Results summary: ";
-        for (auto i = 0; i < result_summary_.classified_counts.size(); i++) {
+        for (auto i = 0; i < result_summary.num_categories; i++) {
             const auto &category = input_summary_.categories.at(i);
-            PLOG_INFO << category << " :\t\t" << result_summary_.classified_counts.at(i);
+            PLOG_INFO << category << " :\t\t" << result_summary.classified_counts.at(i);
         }
-        PLOG_INFO << "unclassified :\t" << result_summary_.unclassified_count;
+        PLOG_INFO << "unclassified :\t" << result_summary.unclassified_count;
     }
 };
 
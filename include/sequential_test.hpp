@@ -0,0 +1,112 @@
+#ifndef CHARON_SEQUENTIAL_TEST_H
+#define CHARON_SEQUENTIAL_TEST_H
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "classify_stats.hpp"
+#include "hit_matrix.hpp"
+#include "input_summary.hpp"
+
+// Wald's sequential probability ratio test deciding between "the read is host" and "the read is not host" as the
+// minimisers of a read are looked up. Each minimiser hits only host bins, only other bins, or neither/both. Under each
+// hypothesis the chance of a host-only or other-only hit is the mean unique proportion of the trained model for that
+// category (positive for the category the read comes from, negative for the other). Once the log likelihood ratio
+// passes the threshold for error rate alpha, and the difference in unique hits already meets the confidence
+// threshold, further minimisers are very unlikely to change the call.
+class SequentialTest {
+private:
+    static constexpr double min_prob{1e-6};
+
+    std::vector<uint64_t> host_mask_{}; // bins of the host category
+    std::vector<uint64_t> other_mask_{}; // bins of the other category
+    double host_step_{0}; // log likelihood ratio for a host-only hit
+    double other_step_{0}; // for an other-only hit
+    double neither_step_{0}; // for a minimiser hitting neither or both
+    double upper_{0};
+    double lower_{0};
+    int32_t confidence_threshold_{0};
+
+    uint32_t num_host_{0};
+    uint32_t num_other_{0};
+    double llr_{0};
+
+    static double clamp(const double p) {
+        return std::clamp(p, min_prob, 1 - min_prob);
+    }
+
+public:
+    SequentialTest() = default;
+
+    SequentialTest(const StatsModel &stats_model, const InputSummary &summary, const uint8_t host_index,
+                   const double alpha) :
+            confidence_threshold_(stats_model.confidence_threshold()) {
+        assert(summary.num_categories() == 2);
+        const uint8_t other_index = 1 - host_index;
+        const auto num_words = (summary.num_bins + 63) / 64;
+        host_mask_.resize(num_words, 0);
+        other_mask_.resize(num_words, 0);
+        for (const auto &[bin, category]: summary.bin_to_category) {
+            auto &mask = summary.category_index(category) == host_index ? host_mask_ : other_mask_;
+            mask[bin >> 6] |= 1ULL << (bin & 63);
+        }
+
+        // probabilities of host-only and other-only hits if the read is host, and if it is not
+        const auto host_if_host = clamp(stats_model.pos_mean(host_index));
+        const auto other_if_host = clamp(stats_model.neg_mean(other_index));
+        const auto host_if_other = clamp(stats_model.neg_mean(host_index));
+        const auto other_if_other = clamp(stats_model.pos_mean(other_index));
+        host_step_ = std::log(host_if_host / host_if_other);
+        other_step_ = std::log(other_if_host / other_if_other);
+        neither_step_ = std::log(clamp(1 - host_if_host - other_if_host) / clamp(1 - host_if_other - other_if_other));
+
+        upper_ = std::log((1 - alpha) / alpha);
+        lower_ = -upper_;
+    }
+
+    bool initialized() const {
+        return not host_mask_.empty();
+    }
+
+    // Start a new read
+    void reset() {
+        num_host_ = 0;
+        num_other_ = 0;
+        llr_ = 0;
+    }
+
+    // Add the hits of rows first onwards, returns true once the test has decided
+    bool update(const HitMatrixView &hits, const uint32_t first) {
+        for (auto i = first; i < hits.num_rows; ++i) {
+            const auto *row = hits.row(i);
+            bool host = false;
+            bool other = false;
+            for (auto word = 0; word < hits.num_words; ++word) {
+                host |= (row[word] & host_mask_[word]) != 0;
+                other |= (row[word] & other_mask_[word]) != 0;
+            }
+            if (host and not other) {
+                num_host_ += 1;
+                llr_ += host_step_;
+            } else if (other and not host) {
+                num_other_ += 1;
+                llr_ += other_step_;
+            } else {
+                llr_ += neither_step_;
+            }
+        }
+        return decided();
+    }
+
+    bool decided() const {
+        const auto difference = static_cast<int32_t>(num_host_) - static_cast<int32_t>(num_other_);
+        return (llr_ >= upper_ and difference >= confidence_threshold_) or
+               (llr_ <= lower_ and -difference >= confidence_threshold_);
+    }
+};
+
+#endif // CHARON_SEQUENTIAL_TEST_H
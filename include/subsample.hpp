@@ -0,0 +1,70 @@
+#ifndef CHARON_SUBSAMPLE_H
+#define CHARON_SUBSAMPLE_H
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "hashing.hpp"
+
+// Caps the number of minimisers looked up for a read. The cost of a read grows with its number of minimisers, but
+// beyond a few thousand the proportions used to call it hardly change, so very long reads can be called from a
+// subsample. Both modes are deterministic and keep the chosen minimisers in read order.
+//
+// even: minimisers at evenly spaced positions along the read.
+// hash: the max_minimisers with the smallest hash (a bottom-k sketch), so the same minimisers are chosen from
+//       overlapping reads wherever they occur.
+class MinimiserSubsampler {
+private:
+    uint32_t max_minimisers_{0};
+    bool by_hash_{false};
+    std::vector<std::pair<uint64_t, uint32_t>> ranked_{}; // (hash, position), reused across reads
+    std::vector<uint32_t> positions_{};
+
+public:
+    MinimiserSubsampler() = default;
+
+    MinimiserSubsampler(MinimiserSubsampler const &) = default;
+
+    MinimiserSubsampler(MinimiserSubsampler &&) = default;
+
+    MinimiserSubsampler &operator=(MinimiserSubsampler const &) = default;
+
+    MinimiserSubsampler &operator=(MinimiserSubsampler &&) = default;
+
+    ~MinimiserSubsampler() = default;
+
+    MinimiserSubsampler(const uint32_t max_minimisers, const bool by_hash) :
+            max_minimisers_(max_minimisers),
+            by_hash_(by_hash) {}
+
+    // Reduces values in place to at most max_minimisers, returns true if any were dropped
+    bool apply(std::vector<uint64_t> &values) {
+        if (max_minimisers_ == 0 or values.size() <= max_minimisers_)
+            return false;
+
+        if (by_hash_) {
+            ranked_.resize(values.size());
+            for (uint32_t i = 0; i < values.size(); ++i)
+                ranked_[i] = {mix64(values[i]), i};
+            std::nth_element(ranked_.begin(), ranked_.begin() + max_minimisers_, ranked_.end());
+            positions_.resize(max_minimisers_);
+            for (uint32_t i = 0; i < max_minimisers_; ++i)
+                positions_[i] = ranked_[i].second;
+            std::sort(positions_.begin(), positions_.end());
+            for (uint32_t i = 0; i < max_minimisers_; ++i)
+                values[i] = values[positions_[i]];
+        } else {
+            const auto num_values = static_cast<uint64_t>(values.size());
+            for (uint64_t i = 0; i < max_minimisers_; ++i)
+                values[i] = values[i * num_values / max_minimisers_];
+        }
+        values.resize(max_minimisers_);
+        return true;
+    }
+};
+
+#endif // CHARON_SUBSAMPLE_H
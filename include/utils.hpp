@@ -14,10 +14,6 @@
 
 class IndexArguments;
 
-struct my_traits : seqan3::sequence_file_input_default_traits_dna {
-    using quality_alphabet = seqan3::phred94;
-};
-
 // used to transform paths to absolute paths - designed to be used with CLI11 transform
 std::filesystem::path make_absolute(std::filesystem::path);
 
@@ -38,6 +34,11 @@ void delete_hashes(const std::vector<uint8_t> &targets, const std::string tmp_ou
 
 size_t bin_size_in_bits(const IndexArguments &opt, const uint64_t &num_elements);
 
+double false_positive_rate(const uint64_t num_elements, const uint64_t num_bits, const uint8_t num_hash);
+
+size_t blocked_bin_size_in_bits(const IndexArguments &opt, const uint64_t &num_elements,
+                                const uint32_t positions_per_block);
+
 size_t max_num_hashes_for_fpr(const IndexArguments &opt);
 
 std::string sequence_to_string(
@@ -47,4 +48,23 @@ float get_compression_ratio(const std::string &sequence);
 
 std::string get_extension(const std::filesystem::path);
 
+uint64_t available_memory_in_bytes();
+
+uint64_t last_level_cache_in_bytes();
+
+void log_lookup_rate(const std::string &layout, const uint64_t num_lookups, const double seconds);
+
+void log_filter_summary(const uint64_t num_filtered, const uint64_t num_bases, const uint64_t num_lookups,
+                        const uint8_t kmer_size, const uint8_t window_size);
+
+void log_thread_utilisation(const std::vector<double> &busy_seconds, const double wall_seconds);
+
+void log_prefilter_summary(const uint64_t num_checked, const uint64_t num_prefiltered);
+
+void log_cascade_summary(const uint64_t num_triaged, const uint64_t num_second_tier);
+
+void log_subsample_summary(const uint64_t num_subsampled, const uint32_t max_minimisers);
+
+void log_early_stop_summary(const uint64_t num_minimisers, const uint64_t num_used, const uint64_t num_stopped_early);
+
 #endif
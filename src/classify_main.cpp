@@ -3,10 +3,11 @@
 #include <algorithm>
 
 #include "classify_main.hpp"
-#include "read_entry.hpp"
 #include "classify_stats.hpp"
 #include "index.hpp"
 #include "load_index.hpp"
+#include "hit_kernels.hpp"
+#include "read_classifier.hpp"
 #include "utils.hpp"
 #include "version.h"
 
@@ -38,11 +39,34 @@ void setup_classify_subcommand(CLI::App &app) {
             ->check(CLI::ExistingFile.description(""))
             ->type_name("FILE");
 
-    classify_subcommand->add_option("--db", opt->db, "Prefix for the index.")
+    classify_subcommand->add_option("--db", opt->db,
+                                  "Prefix for the index. Repeat (or separate with commas) to query several indexes built with the same kmer and window size together.")
             ->type_name("FILE")
             ->required()
+            ->delimiter(',')
+            ->allow_extra_args(false)
             ->check(CLI::ExistingPath.description(""));
 
+    classify_subcommand->add_option("--layout", opt->layout,
+                                    "In-memory layout of the index. The uncompressed layout needs more memory but gives faster lookups, auto chooses it when enough memory is available.")
+            ->type_name("STRING")
+            ->check(CLI::IsMember({"auto", "compressed", "uncompressed"}))
+            ->capture_default_str();
+
+    classify_subcommand->add_flag("--sort_queries", opt->sort_queries,
+                                "Look up the minimisers of each chunk of reads together, sorted by where they are found in the index, to make better use of the cache.");
+
+    classify_subcommand->add_option("--max_minimisers", opt->max_minimisers,
+                                  "Look up at most this many minimisers per read, chosen as set by --subsample (0 for no limit).")
+            ->type_name("INT")
+            ->capture_default_str();
+
+    classify_subcommand->add_option("--subsample", opt->subsample,
+                                  "How minimisers are chosen for reads with more than --max_minimisers: evenly spaced along the read, or those with the smallest hash.")
+            ->type_name("STRING")
+            ->check(CLI::IsMember({"even", "hash"}))
+            ->capture_default_str();
+
     classify_subcommand->add_option("-e,--extract", opt->category_to_extract,
                                     "Reads from this category in the index will be extracted to file.")
             ->type_name("STRING");
@@ -52,9 +76,35 @@ void setup_classify_subcommand(CLI::App &app) {
             ->check(CLI::NonexistentPath.description(""))
             ->default_str("<prefix>");
 
+    classify_subcommand
+            ->add_option("--compression_level", opt->compression_level,
+                         "Gzip compression level of the extracted read files, 0 to write them uncompressed.")
+            ->type_name("INT")
+            ->check(CLI::Range(0, 9))
+            ->capture_default_str();
+
+    classify_subcommand->add_option("-o,--output", opt->output,
+                                    "File for the read assignments (default stdout).")
+            ->type_name("FILE");
+
+    classify_subcommand->add_flag("--ordered", opt->ordered,
+                                  "Write the read assignments in the order of the input reads.");
+
+    classify_subcommand
+            ->add_option("--batch_bases", opt->batch_bases,
+                         "Batches of reads passed to the worker threads are also ended once they hold this many bases, so that batches of long reads are not much more work than batches of short reads.")
+            ->type_name("INT")
+            ->capture_default_str();
+
+    classify_subcommand
+            ->add_option("--split_length", opt->split_length,
+                         "Reads longer than this are hashed and looked up in segments of this length, which other threads can help with (0 to never split).")
+            ->type_name("INT")
+            ->capture_default_str();
+
     classify_subcommand
             ->add_option("--chunk_size", opt->chunk_size,
-                         "Read file is read in chunks of this size, to be processed in parallel within a chunk.")
+                         "Reads are passed to the worker threads in batches of this size.")
             ->type_name("INT")
             ->capture_default_str();
 
@@ -89,6 +139,13 @@ void setup_classify_subcommand(CLI::App &app) {
             ->type_name("FLOAT")
             ->capture_default_str();
 
+    classify_subcommand
+            ->add_option("--complexity", opt->complexity,
+                         "How the compression ratio used by --min_compression is found: estimated from a quick LZ77 parse of the read, or by compressing the read with gzip. The estimate is much faster but can differ from gzip (by 0.013 on average on simulated reads), so reads close to --min_compression may be filtered differently.")
+            ->type_name("STRING")
+            ->check(CLI::IsMember({"estimate", "gzip"}))
+            ->capture_default_str();
+
     classify_subcommand
             ->add_option("--confidence", opt->confidence_threshold,
                          "Minimum difference between the top 2 unique hit counts.")
@@ -110,6 +167,12 @@ void setup_classify_subcommand(CLI::App &app) {
             ->type_name("INT")
             ->capture_default_str();
 
+    classify_subcommand
+            ->add_option("--decompression_threads", opt->decompression_threads,
+                         "Threads used to decompress BGZF (e.g. bgzip) input, in addition to --threads. Other gzip input is decompressed on one thread.")
+            ->type_name("INT")
+            ->capture_default_str();
+
     classify_subcommand->add_flag(
             "-v", opt->verbosity, "Verbosity of logging. Repeat for increased verbosity");
 
@@ -118,169 +181,15 @@ void setup_classify_subcommand(CLI::App &app) {
     classify_subcommand->callback([opt]() { classify_main(*opt); });
 }
 
-void classify_reads(const ClassifyArguments &opt, const Index &index) {
+void classify_reads(const ClassifyArguments &opt, const IndexSet &index) {
     PLOG_INFO << "Classifying file " << opt.read_file;
-
-    auto hash_adaptor = seqan3::views::minimiser_hash(seqan3::shape{seqan3::ungapped{index.kmer_size()}},
-                                                      seqan3::window_size{index.window_size()});
-    PLOG_VERBOSE << "Defined hash_adaptor";
-
-    auto agent = index.agent();
-    PLOG_VERBOSE << "Defined agent";
-
-    seqan3::sequence_file_input<my_traits> fin{opt.read_file};
-    using record_type = decltype(fin)::record_type;
-    std::vector<record_type> records{};
-
-    using outfile_field_ids = decltype(fin)::field_ids;
-    using outfile_format = decltype(fin)::valid_formats;
-
-    auto result = Result<record_type, outfile_field_ids, outfile_format>(opt, index.summary());
-
-    PLOG_DEBUG << "Defined Result with " << +index.num_bins() << " bins";
-
-    for (auto &&chunk: fin | seqan3::views::chunk(opt.chunk_size)) {
-        // You can use a for loop:
-        for (auto &record: chunk) {
-            records.push_back(std::move(record));
-        }
-
-#pragma omp parallel for firstprivate(agent, hash_adaptor) num_threads(opt.threads) shared(result)
-        for (auto i = 0; i < records.size(); ++i) {
-
-            const record_type &record = records[i];
-            const auto read_id = split(record.id(), " ")[0];
-            const auto read_length = record.sequence().size();
-            if (read_length > std::numeric_limits<uint32_t>::max()) {
-                PLOG_WARNING << "Ignoring read " << record.id() << " as too long!";
-                continue;
-            }
-            if (read_length == 0) {
-                PLOG_WARNING << "Ignoring read " << record.id() << " as has zero length!";
-                continue;
-            }
-            auto qualities = record.base_qualities() |
-                             std::views::transform([](auto quality) { return seqan3::to_phred(quality); });
-            auto sum = std::accumulate(qualities.begin(), qualities.end(), 0);
-            float mean_quality = 0;
-            if (std::ranges::size(qualities) > 0)
-                mean_quality = static_cast< float >( sum ) / static_cast< float >(std::ranges::size(qualities));
-            PLOG_VERBOSE << "Mean quality of read  " << record.id() << " is " << mean_quality;
-
-            float compression_ratio = get_compression_ratio(sequence_to_string(record.sequence()));
-            PLOG_VERBOSE << "Found compression ratio of read  " << record.id() << " is " << compression_ratio;
-
-            auto read = ReadEntry(read_id, read_length, mean_quality, compression_ratio, result.input_summary());
-            for (auto &&value: record.sequence() | hash_adaptor) {
-                const auto &entry = agent.bulk_contains(value);
-                read.update_entry(entry);
-            }
-            PLOG_VERBOSE << "Finished adding raw hash counts for read " << read_id;
-
-            read.post_process(result.input_summary());
-#pragma omp critical(add_read_to_results)
-            result.add_read(read, record);
-        }
-        records.clear();
-    }
-    result.complete();
-    result.print_summary();
+    classify_input<false>(opt, index, PipelineSettings());
 }
 
 
-void classify_paired_reads(const ClassifyArguments &opt, const Index &index) {
+void classify_paired_reads(const ClassifyArguments &opt, const IndexSet &index) {
     PLOG_INFO << "Classifying files " << opt.read_file << " and " << opt.read_file2;
-
-    auto hash_adaptor = seqan3::views::minimiser_hash(seqan3::shape{seqan3::ungapped{index.kmer_size()}},
-                                                      seqan3::window_size{index.window_size()});
-    PLOG_VERBOSE << "Defined hash_adaptor";
-
-    auto agent = index.agent();
-    PLOG_VERBOSE << "Defined agent";
-
-    seqan3::sequence_file_input<my_traits> fin1{opt.read_file};
-    seqan3::sequence_file_input<my_traits> fin2{opt.read_file2};
-    using record_type = decltype(fin1)::record_type;
-    std::vector<record_type> records1{};
-    std::vector<record_type> records2{};
-
-    using outfile_field_ids = decltype(fin1)::field_ids;
-    using outfile_format = decltype(fin1)::valid_formats;
-
-    auto result = Result<record_type, outfile_field_ids, outfile_format>(opt, index.summary());
-
-    PLOG_DEBUG << "Defined Result with " << +index.num_bins() << " bins";
-
-    for (auto &&chunk: fin1 | seqan3::views::chunk(opt.chunk_size)) {
-        for (auto &record: chunk) {
-            records1.push_back(std::move(record));
-        }
-
-        // loop in the second file and get same amount of reads
-        for (auto &record2: fin2 | std::views::take(opt.chunk_size)) {
-            records2.push_back(std::move(record2));
-        }
-
-#pragma omp parallel for firstprivate(agent, hash_adaptor) num_threads(opt.threads) shared(result)
-        for (auto i = 0; i < records1.size(); ++i) {
-
-            const auto &record1 = records1[i];
-            const auto &record2 = records2[i];
-
-            auto id1 = record1.id();
-            id1.erase(id1.size() - 1);
-            auto id2 = record2.id();
-            id2.erase(id2.size() - 1);
-            if (id1 != id2) {
-                std::cout << id1 << " " << id2;
-                throw std::runtime_error("Your pairs don't match for read ids.");
-            }
-            const auto read_id = split(record1.id(), " ")[0];
-            const auto read_length = record1.sequence().size() + record2.sequence().size();
-            if (read_length > std::numeric_limits<uint32_t>::max()) {
-                PLOG_WARNING << "Ignoring read " << record1.id() << " as too long!";
-                continue;
-            }
-            if (read_length == 0) {
-                PLOG_WARNING << "Ignoring read " << record1.id() << " as has zero length!";
-                continue;
-            }
-            auto qualities1 = record1.base_qualities() |
-                              std::views::transform([](auto quality) { return seqan3::to_phred(quality); });
-            auto qualities2 = record2.base_qualities() |
-                              std::views::transform([](auto quality) { return seqan3::to_phred(quality); });
-            auto sum = std::accumulate(qualities1.begin(), qualities1.end(), 0);
-            sum = std::accumulate(qualities2.begin(), qualities2.end(), sum);
-            float mean_quality = 0;
-            if (std::ranges::size(qualities1) + std::ranges::size(qualities2) > 0)
-                mean_quality = static_cast< float >( sum ) /
-                               static_cast< float >(std::ranges::size(qualities1) + std::ranges::size(qualities2));
-            PLOG_VERBOSE << "Mean quality of read  " << record1.id() << " is " << mean_quality;
-
-            auto combined_record = sequence_to_string(record1.sequence()) + sequence_to_string(record2.sequence());
-            float compression_ratio = get_compression_ratio(combined_record);
-            PLOG_VERBOSE << "Found compression ratio of read  " << record1.id() << " is " << compression_ratio;
-
-            auto read = ReadEntry(read_id, read_length, mean_quality, compression_ratio, result.input_summary());
-            for (auto &&value: record1.sequence() | hash_adaptor) {
-                const auto &entry = agent.bulk_contains(value);
-                read.update_entry(entry);
-            }
-            for (auto &&value: record2.sequence() | hash_adaptor) {
-                const auto &entry = agent.bulk_contains(value);
-                read.update_entry(entry);
-            }
-            PLOG_VERBOSE << "Finished adding raw hash counts for read " << read_id;
-
-            read.post_process(result.input_summary());
-#pragma omp critical(add_read_to_results)
-            result.add_paired_read(read, record1, record2);
-        }
-        records1.clear();
-        records2.clear();
-    }
-    result.complete();
-    result.print_summary();
+    classify_input<true>(opt, index, PipelineSettings());
 }
 
 
@@ -293,8 +202,10 @@ int classify_main(ClassifyArguments &opt) {
     }
     plog::init(log_level, opt.log_file.c_str(), 10000000, 5);
 
-    if (!ends_with(opt.db, ".idx")) {
-        opt.db += ".idx";
+    for (auto &db_file: opt.db) {
+        if (!ends_with(db_file, ".idx")) {
+            db_file += ".idx";
+        }
     }
 
     if (opt.read_file2 != "") {
@@ -304,9 +215,10 @@ int classify_main(ClassifyArguments &opt) {
 
     auto args = opt.to_string();
     LOG_INFO << "Running charon classify\n\nCharon version: " << SOFTWARE_VERSION << "\n" << args;
+    PLOG_INFO << "Using " << hit_kernel_name() << " kernels to count hits";
 
-    auto index = Index();
-    load_index(index, opt.db);
+    auto index = IndexSet();
+    load_indexes(index, opt.db, opt.layout, opt.threads);
 
     opt.run_extract = (opt.category_to_extract != "");
     const auto categories = index.categories();
@@ -325,16 +237,17 @@ int classify_main(ClassifyArguments &opt) {
             to_extract = categories;
         else
             to_extract.push_back(opt.category_to_extract);
-        const auto extension = get_extension(opt.read_file);
+        // extracted reads are written as BGZF, i.e. gzip, unless uncompressed
+        const auto extension = get_extension(opt.read_file) + (opt.compression_level > 0 ? ".gz" : "");
         for (const auto &category: to_extract) {
             const auto category_index = index.get_category_index(category);
             if (opt.is_paired) {
                 opt.extract_category_to_file[category_index].push_back(
-                        opt.prefix + "_" + category + "_1" + extension + ".gz");
+                        opt.prefix + "_" + category + "_1" + extension);
                 opt.extract_category_to_file[category_index].push_back(
-                        opt.prefix + "_" + category + "_2" + extension + ".gz");
+                        opt.prefix + "_" + category + "_2" + extension);
             } else {
-                opt.extract_category_to_file[category_index].push_back(opt.prefix + "_" + category + extension + ".gz");
+                opt.extract_category_to_file[category_index].push_back(opt.prefix + "_" + category + extension);
             }
         }
     }
@@ -0,0 +1,249 @@
+#include <fstream>
+#include <memory>
+#include <string_view>
+
+#include "extract_main.hpp"
+#include "extract_arguments.hpp"
+#include "decompressed_input.hpp"
+#include "extract_writer.hpp"
+#include "read_pipeline.hpp"
+#include "utils.hpp"
+#include "version.h"
+
+#include <plog/Log.h>
+#include <plog/Initializers/RollingFileInitializer.h>
+
+
+void setup_extract_subcommand(CLI::App &app) {
+    auto opt = std::make_shared<ExtractArguments>();
+    auto *extract_subcommand = app.add_subcommand(
+            "extract", "Extract reads of some categories using the assignments written by classify or dehost.");
+
+    extract_subcommand->add_option("<fastaq>", opt->read_file, "Fasta/q file")
+            ->transform(make_absolute)
+            ->check(CLI::ExistingFile.description(""))
+            ->type_name("FILE");
+
+    extract_subcommand->add_option("<fastaq>", opt->read_file2, "Paired Fasta/q file")
+            ->transform(make_absolute)
+            ->check(CLI::ExistingFile.description(""))
+            ->type_name("FILE");
+
+    extract_subcommand->add_option("-a,--assignments", opt->assignments,
+                                   "Read assignments written by classify or dehost (may be gzipped).")
+            ->required()
+            ->transform(make_absolute)
+            ->check(CLI::ExistingFile.description(""))
+            ->type_name("FILE");
+
+    extract_subcommand->add_option("-e,--category", opt->categories,
+                                   "Category to extract. Repeat (or separate with commas) for several, use all for every category called and unclassified for reads without a call.")
+            ->required()
+            ->delimiter(',')
+            ->allow_extra_args(false)
+            ->type_name("STRING");
+
+    extract_subcommand->add_option("-p,--prefix", opt->prefix, "Prefix for the output files.")
+            ->type_name("FILE")
+            ->check(CLI::NonexistentPath.description(""))
+            ->default_str("<prefix>");
+
+    extract_subcommand
+            ->add_option("--compression_level", opt->compression_level,
+                         "Gzip compression level of the extracted read files, 0 to write them uncompressed.")
+            ->type_name("INT")
+            ->check(CLI::Range(0, 9))
+            ->capture_default_str();
+
+    extract_subcommand->add_flag("--ids_only", opt->ids_only,
+                                 "Only write the ids of the reads in each category, one per line, without reading the reads.");
+
+    extract_subcommand
+            ->add_option("--batch_bases", opt->batch_bases,
+                         "Batches of reads passed to the worker threads are also ended once they hold this many bases.")
+            ->type_name("INT")
+            ->capture_default_str();
+
+    extract_subcommand
+            ->add_option("--chunk_size", opt->chunk_size,
+                         "Reads are passed to the worker threads in batches of this size.")
+            ->type_name("INT")
+            ->capture_default_str();
+
+    extract_subcommand->add_option("--log", opt->log_file, "File for log")
+            ->transform(make_absolute)
+            ->type_name("FILE");
+
+    extract_subcommand
+            ->add_option("-t,--threads", opt->threads, "Maximum number of threads to use.")
+            ->type_name("INT")
+            ->capture_default_str();
+
+    extract_subcommand
+            ->add_option("--decompression_threads", opt->decompression_threads,
+                         "Threads used to decompress BGZF (e.g. bgzip) input, in addition to --threads. Other gzip input is decompressed on one thread.")
+            ->type_name("INT")
+            ->capture_default_str();
+
+    extract_subcommand->add_flag(
+            "-v", opt->verbosity, "Verbosity of logging. Repeat for increased verbosity");
+
+    // Set the function that will be called when this subcommand is issued.
+    extract_subcommand->callback([opt]() { extract_main(*opt); });
+}
+
+// the read id as written to the assignments, i.e. the header up to the first space
+static std::string_view assignment_read_id(const std::string &id) {
+    return std::string_view(id).substr(0, id.find(' '));
+}
+
+static std::string extract_file(const ExtractArguments &opt, const std::string &category, const std::string &suffix) {
+    // extracted reads are written as BGZF, i.e. gzip, unless uncompressed
+    return opt.prefix + "_" + category + suffix + get_extension(opt.read_file) + (opt.compression_level > 0 ? ".gz" : "");
+}
+
+void extract_reads(const ExtractArguments &opt, const AssignmentTable &table) {
+    PLOG_INFO << "Extracting reads from file " << opt.read_file;
+
+    auto writer = ExtractWriter(opt.compression_level, opt.threads);
+    std::vector<size_t> outputs;
+    for (const auto &category: table.categories())
+        outputs.push_back(writer.add_output({extract_file(opt, category, "")}));
+    writer.start();
+
+    auto input = DecompressedInput(opt.read_file, opt.decompression_threads);
+    auto fin = input.open();
+    using record_type = decltype(fin)::record_type;
+
+    uint64_t num_reads = 0;
+    uint64_t num_extracted = 0;
+    auto reader = ReadBatchReader(fin, opt.chunk_size, opt.batch_bases, 2 * opt.threads);
+#pragma omp parallel num_threads(opt.threads) shared(reader, writer, table, outputs) reduction(+:num_reads, num_extracted)
+    {
+        ReadBatch<record_type> batch;
+        while (reader.next(batch)) {
+            for (const auto &record: batch.records) {
+                num_reads += 1;
+                const auto category_index = table.find(assignment_read_id(record.id()));
+                if (category_index < 0)
+                    continue;
+                writer.add(outputs[category_index], record);
+                num_extracted += 1;
+            }
+        }
+    }
+    reader.finish();
+    input.close();
+    writer.close();
+    PLOG_INFO << "Extracted " << num_extracted << " of " << num_reads << " reads";
+    if (num_extracted < table.size())
+        PLOG_WARNING << table.size() - num_extracted << " reads in the assignments were not found in the reads";
+}
+
+void extract_paired_reads(const ExtractArguments &opt, const AssignmentTable &table) {
+    PLOG_INFO << "Extracting reads from files " << opt.read_file << " and " << opt.read_file2;
+
+    auto writer = ExtractWriter(opt.compression_level, opt.threads);
+    std::vector<size_t> outputs;
+    for (const auto &category: table.categories())
+        outputs.push_back(writer.add_output({extract_file(opt, category, "_1"), extract_file(opt, category, "_2")}));
+    writer.start();
+
+    auto input1 = DecompressedInput(opt.read_file, opt.decompression_threads);
+    auto input2 = DecompressedInput(opt.read_file2, opt.decompression_threads);
+    auto fin1 = input1.open();
+    auto fin2 = input2.open();
+    using record_type = decltype(fin1)::record_type;
+
+    uint64_t num_reads = 0;
+    uint64_t num_extracted = 0;
+    auto reader = ReadBatchReader(fin1, fin2, opt.chunk_size, opt.batch_bases, 2 * opt.threads);
+#pragma omp parallel num_threads(opt.threads) shared(reader, writer, table, outputs) reduction(+:num_reads, num_extracted)
+    {
+        ReadBatch<record_type> batch;
+        while (reader.next(batch)) {
+            for (auto i = 0; i < batch.records.size(); ++i) {
+                num_reads += 1;
+                // paired reads are assigned by the id of the first mate
+                const auto category_index = table.find(assignment_read_id(batch.records[i].id()));
+                if (category_index < 0)
+                    continue;
+                writer.add_pair(outputs[category_index], batch.records[i], batch.records2.at(i));
+                num_extracted += 1;
+            }
+        }
+    }
+    reader.finish();
+    input1.close();
+    input2.close();
+    writer.close();
+    PLOG_INFO << "Extracted " << num_extracted << " of " << num_reads << " read pairs";
+    if (num_extracted < table.size())
+        PLOG_WARNING << table.size() - num_extracted << " reads in the assignments were not found in the reads";
+}
+
+// Writes the ids of the reads in each extracted category to <prefix>_<category>_ids.txt
+void write_read_ids(const ExtractArguments &opt, AssignmentTable &table, std::istream &assignments) {
+    std::vector<std::unique_ptr<std::ofstream>> files;
+    std::vector<uint64_t> counts;
+    table.read(assignments, [&](const uint8_t category_index, const std::string_view read_id) {
+        while (files.size() <= category_index) {
+            const auto path = opt.prefix + "_" + table.categories().at(files.size()) + "_ids.txt";
+            files.push_back(std::make_unique<std::ofstream>(path));
+            if (not *files.back()) {
+                PLOG_ERROR << "Could not open " << path << " for writing";
+                exit(1);
+            }
+            counts.push_back(0);
+        }
+        *files[category_index] << read_id << '\n';
+        counts[category_index] += 1;
+    });
+    for (auto i = 0; i < counts.size(); ++i)
+        PLOG_INFO << "Wrote " << counts[i] << " read ids of category " << table.categories().at(i);
+}
+
+int extract_main(ExtractArguments &opt) {
+    auto log_level = plog::info;
+    if (opt.verbosity == 1) {
+        log_level = plog::debug;
+    } else if (opt.verbosity > 1) {
+        log_level = plog::verbose;
+    }
+    plog::init(log_level, opt.log_file.c_str(), 10000000, 5);
+
+    if (opt.read_file2 != "")
+        opt.is_paired = true;
+    if (opt.prefix == "")
+        opt.prefix = "charon";
+
+    auto args = opt.to_string();
+    LOG_INFO << "Running charon extract\n\nCharon version: " << SOFTWARE_VERSION << "\n" << args;
+
+    if (not opt.ids_only and opt.read_file == "") {
+        PLOG_ERROR << "Reads to extract from are required unless --ids_only";
+        return 1;
+    }
+
+    auto table = AssignmentTable(opt.categories);
+    auto assignments = DecompressedInput(opt.assignments, opt.decompression_threads);
+    if (opt.ids_only) {
+        write_read_ids(opt, table, assignments.stream());
+        assignments.close();
+        return 0;
+    }
+
+    table.load(assignments.stream());
+    assignments.close();
+    PLOG_INFO << "Loaded " << table.num_assignments() << " assignments, of which " << table.size()
+              << " reads are to be extracted";
+    for (const auto &category: table.categories())
+        PLOG_DEBUG << "Extracting category " << category;
+
+    if (opt.is_paired)
+        extract_paired_reads(opt, table);
+    else
+        extract_reads(opt, table);
+
+    return 0;
+}
@@ -0,0 +1,295 @@
+#include "hit_kernels.hpp"
+
+#include <algorithm>
+#include <bit>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+enum class KernelLevel : uint8_t {
+    scalar,
+    avx2,
+    avx512
+};
+
+KernelLevel detect_kernel_level() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return KernelLevel::avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return KernelLevel::avx2;
+#endif
+    return KernelLevel::scalar;
+}
+
+KernelLevel kernel_level() {
+    static const KernelLevel level = detect_kernel_level();
+    return level;
+}
+
+// Bit-plane counters: plane p of a lane holds bit p of the count for each of its 64 bins. With 8 planes the counters
+// must be flushed to the totals at least every 255 additions.
+constexpr uint8_t num_planes{8};
+constexpr uint32_t max_pending{(1u << num_planes) - 1};
+
+void flush_planes(const uint64_t *planes, const uint8_t num_lanes, uint32_t *totals) {
+    for (auto p = 0; p < num_planes; ++p) {
+        for (auto lane = 0; lane < num_lanes; ++lane) {
+            auto bits = planes[p * num_lanes + lane];
+            while (bits != 0) {
+                totals[std::countr_zero(bits)] += 1u << p;
+                bits &= bits - 1;
+            }
+        }
+    }
+}
+
+void count_bin_hits_rows(const HitMatrixView &hits, const uint32_t first, uint32_t *totals) {
+    for (auto i = first; i < hits.num_rows; ++i) {
+        const auto *entry = hits.row(i);
+        for (auto word = 0; word < hits.num_words; ++word) {
+            auto bits = entry[word];
+            while (bits != 0) {
+                totals[word * 64 + std::countr_zero(bits)] += 1;
+                bits &= bits - 1;
+            }
+        }
+    }
+}
+
+// Set bit i of the result if row first + i has a hit in bin, for up to 64 rows
+uint64_t extract_column(const HitMatrixView &hits, const uint32_t first, const uint32_t last, const uint8_t bin) {
+    const auto word = bin >> 6;
+    const auto bit = bin & 63;
+    uint64_t column = 0;
+    for (auto i = first; i < last; ++i)
+        column |= ((hits.row(i)[word] >> bit) & 1ULL) << (i - first);
+    return column;
+}
+
+// Given the column of each category for a block of rows, count the rows hit in exactly one category
+void count_exactly_one(const uint64_t *columns, const uint8_t num_categories, uint32_t *unique_counts) {
+    uint64_t ones = 0;
+    uint64_t twos = 0;
+    for (auto category = 0; category < num_categories; ++category) {
+        twos |= ones & columns[category];
+        ones |= columns[category];
+    }
+    const auto exactly_one = ones & ~twos;
+    for (auto category = 0; category < num_categories; ++category)
+        unique_counts[category] += std::popcount(columns[category] & exactly_one);
+}
+
+void count_unique_category_hits_scalar(const HitMatrixView &hits, const uint8_t *category_bins,
+                                       const uint8_t num_categories, uint32_t *unique_counts) {
+    uint64_t columns[256];
+    for (uint32_t first = 0; first < hits.num_rows; first += 64) {
+        const auto last = std::min<uint32_t>(first + 64, hits.num_rows);
+        for (auto category = 0; category < num_categories; ++category) {
+            const auto &bin = category_bins[category];
+            columns[category] = bin < hits.num_words * 64 ? extract_column(hits, first, last, bin) : 0;
+        }
+        count_exactly_one(columns, num_categories, unique_counts);
+    }
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx2")))
+void count_bin_hits_avx2(const HitMatrixView &hits, uint32_t *totals) {
+    constexpr uint8_t num_lanes = 4;
+    const uint32_t num_groups = hits.num_rows / num_lanes;
+    const int64_t stride = hits.num_words;
+    const __m256i offsets = _mm256_set_epi64x(3 * stride, 2 * stride, stride, 0);
+    alignas(32) uint64_t planes[num_planes * num_lanes];
+
+    for (auto word = 0; word < hits.num_words; ++word) {
+        __m256i counters[num_planes];
+        for (auto &counter: counters)
+            counter = _mm256_setzero_si256();
+        uint32_t pending = 0;
+
+        for (uint32_t group = 0; group < num_groups; ++group) {
+            const auto *base = hits.data + static_cast<size_t>(group) * num_lanes * stride + word;
+            __m256i carry = stride == 1 ? _mm256_loadu_si256(reinterpret_cast<const __m256i *>(base))
+                                        : _mm256_i64gather_epi64(reinterpret_cast<const long long *>(base), offsets, 8);
+            for (auto &counter: counters) {
+                const auto next = _mm256_and_si256(counter, carry);
+                counter = _mm256_xor_si256(counter, carry);
+                carry = next;
+            }
+            if (++pending == max_pending or group + 1 == num_groups) {
+                for (auto p = 0; p < num_planes; ++p) {
+                    _mm256_store_si256(reinterpret_cast<__m256i *>(planes + p * num_lanes), counters[p]);
+                    counters[p] = _mm256_setzero_si256();
+                }
+                flush_planes(planes, num_lanes, totals + word * 64);
+                pending = 0;
+            }
+        }
+    }
+    count_bin_hits_rows(hits, num_groups * num_lanes, totals);
+}
+
+__attribute__((target("avx2")))
+void count_unique_category_hits_avx2(const HitMatrixView &hits, const uint8_t *category_bins,
+                                     const uint8_t num_categories, uint32_t *unique_counts) {
+    constexpr uint8_t num_lanes = 4;
+    const int64_t stride = hits.num_words;
+    const __m256i offsets = _mm256_set_epi64x(3 * stride, 2 * stride, stride, 0);
+    const uint32_t num_blocks = hits.num_rows / 64;
+    uint64_t columns[256];
+
+    for (uint32_t block = 0; block < num_blocks; ++block) {
+        for (auto category = 0; category < num_categories; ++category) {
+            const auto &bin = category_bins[category];
+            columns[category] = 0;
+            if (bin >= hits.num_words * 64)
+                continue;
+            const auto word = bin >> 6;
+            const auto shift = _mm_cvtsi32_si128(63 - (bin & 63));
+            for (auto group = 0; group < 64 / num_lanes; ++group) {
+                const auto *base = hits.data + (static_cast<size_t>(block) * 64 + group * num_lanes) * stride + word;
+                const auto rows = stride == 1 ? _mm256_loadu_si256(reinterpret_cast<const __m256i *>(base))
+                                              : _mm256_i64gather_epi64(reinterpret_cast<const long long *>(base),
+                                                                       offsets, 8);
+                // move the bit for the bin into the sign bit of each lane
+                const auto signs = _mm256_castsi256_pd(_mm256_sll_epi64(rows, shift));
+                columns[category] |= static_cast<uint64_t>(_mm256_movemask_pd(signs)) << (group * num_lanes);
+            }
+        }
+        count_exactly_one(columns, num_categories, unique_counts);
+    }
+
+    for (uint32_t first = num_blocks * 64; first < hits.num_rows; first += 64) {
+        const auto last = std::min<uint32_t>(first + 64, hits.num_rows);
+        for (auto category = 0; category < num_categories; ++category) {
+            const auto &bin = category_bins[category];
+            columns[category] = bin < hits.num_words * 64 ? extract_column(hits, first, last, bin) : 0;
+        }
+        count_exactly_one(columns, num_categories, unique_counts);
+    }
+}
+
+__attribute__((target("avx512f")))
+void count_bin_hits_avx512(const HitMatrixView &hits, uint32_t *totals) {
+    constexpr uint8_t num_lanes = 8;
+    const uint32_t num_groups = hits.num_rows / num_lanes;
+    const int64_t stride = hits.num_words;
+    const __m512i offsets = _mm512_set_epi64(7 * stride, 6 * stride, 5 * stride, 4 * stride, 3 * stride, 2 * stride,
+                                             stride, 0);
+    alignas(64) uint64_t planes[num_planes * num_lanes];
+
+    for (auto word = 0; word < hits.num_words; ++word) {
+        __m512i counters[num_planes];
+        for (auto &counter: counters)
+            counter = _mm512_setzero_si512();
+        uint32_t pending = 0;
+
+        for (uint32_t group = 0; group < num_groups; ++group) {
+            const auto *base = hits.data + static_cast<size_t>(group) * num_lanes * stride + word;
+            __m512i carry = stride == 1 ? _mm512_loadu_si512(base) : _mm512_i64gather_epi64(offsets, base, 8);
+            for (auto &counter: counters) {
+                const auto next = _mm512_and_si512(counter, carry);
+                counter = _mm512_xor_si512(counter, carry);
+                carry = next;
+            }
+            if (++pending == max_pending or group + 1 == num_groups) {
+                for (auto p = 0; p < num_planes; ++p) {
+                    _mm512_store_si512(planes + p * num_lanes, counters[p]);
+                    counters[p] = _mm512_setzero_si512();
+                }
+                flush_planes(planes, num_lanes, totals + word * 64);
+                pending = 0;
+            }
+        }
+    }
+    count_bin_hits_rows(hits, num_groups * num_lanes, totals);
+}
+
+__attribute__((target("avx512f")))
+void count_unique_category_hits_avx512(const HitMatrixView &hits, const uint8_t *category_bins,
+                                       const uint8_t num_categories, uint32_t *unique_counts) {
+    constexpr uint8_t num_lanes = 8;
+    const int64_t stride = hits.num_words;
+    const __m512i offsets = _mm512_set_epi64(7 * stride, 6 * stride, 5 * stride, 4 * stride, 3 * stride, 2 * stride,
+                                             stride, 0);
+    const uint32_t num_blocks = hits.num_rows / 64;
+    uint64_t columns[256];
+
+    for (uint32_t block = 0; block < num_blocks; ++block) {
+        for (auto category = 0; category < num_categories; ++category) {
+            const auto &bin = category_bins[category];
+            columns[category] = 0;
+            if (bin >= hits.num_words * 64)
+                continue;
+            const auto word = bin >> 6;
+            const auto mask = _mm512_set1_epi64(static_cast<int64_t>(1ULL << (bin & 63)));
+            for (auto group = 0; group < 64 / num_lanes; ++group) {
+                const auto *base = hits.data + (static_cast<size_t>(block) * 64 + group * num_lanes) * stride + word;
+                const auto rows = stride == 1 ? _mm512_loadu_si512(base) : _mm512_i64gather_epi64(offsets, base, 8);
+                columns[category] |= static_cast<uint64_t>(_mm512_test_epi64_mask(rows, mask)) << (group * num_lanes);
+            }
+        }
+        count_exactly_one(columns, num_categories, unique_counts);
+    }
+
+    for (uint32_t first = num_blocks * 64; first < hits.num_rows; first += 64) {
+        const auto last = std::min<uint32_t>(first + 64, hits.num_rows);
+        for (auto category = 0; category < num_categories; ++category) {
+            const auto &bin = category_bins[category];
+            columns[category] = bin < hits.num_words * 64 ? extract_column(hits, first, last, bin) : 0;
+        }
+        count_exactly_one(columns, num_categories, unique_counts);
+    }
+}
+
+#endif
+
+} // namespace
+
+void count_bin_hits(const HitMatrixView &hits, uint32_t *totals) {
+    switch (kernel_level()) {
+#if defined(__x86_64__)
+        case KernelLevel::avx512:
+            count_bin_hits_avx512(hits, totals);
+            return;
+        case KernelLevel::avx2:
+            count_bin_hits_avx2(hits, totals);
+            return;
+#endif
+        default:
+            count_bin_hits_rows(hits, 0, totals);
+    }
+}
+
+void count_unique_category_hits(const HitMatrixView &hits, const uint8_t *category_bins, const uint8_t num_categories,
+                                uint32_t *unique_counts) {
+    switch (kernel_level()) {
+#if defined(__x86_64__)
+        case KernelLevel::avx512:
+            count_unique_category_hits_avx512(hits, category_bins, num_categories, unique_counts);
+            return;
+        case KernelLevel::avx2:
+            count_unique_category_hits_avx2(hits, category_bins, num_categories, unique_counts);
+            return;
+#endif
+        default:
+            count_unique_category_hits_scalar(hits, category_bins, num_categories, unique_counts);
+    }
+}
+
+std::string hit_kernel_name() {
+    switch (kernel_level()) {
+        case KernelLevel::avx512:
+            return "AVX-512";
+        case KernelLevel::avx2:
+            return "AVX2";
+        default:
+            return "scalar";
+    }
+}
@@ -4,12 +4,15 @@
 #include <fstream>
 #include <string>
 #include <algorithm>
+#include <type_traits>
 
 #include "index_main.hpp"
 #include "utils.hpp"
 #include "index.hpp"
 #include "store_index.hpp"
 #include "input_summary.hpp"
+#include "hashing.hpp"
+#include "minimiser.hpp"
 #include "version.h"
 
 #include <plog/Log.h>
@@ -63,6 +66,27 @@ void setup_index_subcommand(CLI::App &app) {
     index_subcommand->add_flag(
             "--optimize", opt->optimize, "Compress the number of bins for improved classification run time");
 
+    auto *blocked_flag = index_subcommand->add_flag(
+            "--blocked", opt->blocked,
+            "Build a cache-line blocked Bloom filter instead of an IBF: one memory access per lookup, but about 3 times the memory (more above 64 bins) for the same false positive rate");
+
+    index_subcommand->add_flag(
+                    "--exact", opt->exact,
+                    "Build an exact hash table of minimisers instead of an IBF: no false positives, for reference panels which fit in memory")
+            ->excludes(blocked_flag);
+
+    index_subcommand
+            ->add_option("--triage", opt->triage_rate,
+                         "Also build a small triage IBF from 1 in this many minimisers, used by dehost --cascade (0 for none).")
+            ->type_name("INT")
+            ->capture_default_str();
+
+    index_subcommand
+            ->add_option("--prefilter", opt->prefilter_rate,
+                         "Also build a small host prefilter from 1 in this many host-unique minimisers, used by dehost --prefilter (0 for none).")
+            ->type_name("INT")
+            ->capture_default_str();
+
     index_subcommand->add_flag(
             "-v", opt->verbosity, "Verbosity of logging. Repeat for increased verbosity");
 
@@ -117,16 +141,15 @@ InputSummary parse_input_file(const std::filesystem::path &input_file) {
 
 InputStats count_and_store_hashes(const IndexArguments &opt, const InputSummary &summary) {
     PLOG_INFO << "Extracting hashes from files";
-    const auto hash_adaptor = seqan3::views::minimiser_hash(seqan3::shape{seqan3::ungapped{opt.kmer_size}},
-                                                            seqan3::window_size{opt.window_size});
-    PLOG_DEBUG << "Defined hash adaptor";
+    auto hasher = MinimiserHasher(opt.kmer_size, opt.window_size);
+    PLOG_INFO << "Using the " << hasher.name() << " minimiser kernel";
     InputStats stats;
     PLOG_DEBUG << "Defined stats";
 
     const auto max_num_hashes = max_num_hashes_for_fpr(opt);
     PLOG_INFO << "Maximum hashes permitted per bin for fpr rate " << opt.max_fpr << " is " << max_num_hashes;
 
-#pragma omp parallel for num_threads(opt.threads)
+#pragma omp parallel for num_threads(opt.threads) firstprivate(hasher)
     for (const auto pair: summary.filepath_to_bin) {
         const auto &fasta_file = pair.first;
         const auto &bin = pair.second;
@@ -139,10 +162,12 @@ InputStats count_and_store_hashes(const IndexArguments &opt, const InputSummary
 
         auto record_count = 0;
         std::unordered_set<uint64_t> hashes;
+        std::vector<uint64_t> minimisers;
         for (const auto &record: fin) {
             stats.records_per_bin[bin] += 1;
-            const auto mh = record.sequence() | hash_adaptor | std::views::common;
-            hashes.insert(mh.begin(), mh.end());
+            minimisers.clear();
+            hasher.compute(record.sequence(), minimisers);
+            hashes.insert(minimisers.begin(), minimisers.end());
             record_count++;
         }
         store_hashes(std::to_string(bin), hashes, opt.tmp_dir);
@@ -235,11 +260,66 @@ optimize_layout(const IndexArguments &opt, InputSummary &summary, InputStats &st
     return bucket_to_bins_map;
 }
 
-Index build_index(const IndexArguments &opt, const InputSummary &summary, InputStats &stats,
-                  const std::unordered_map<uint8_t, std::vector<uint8_t>> &bucket_to_bins_map) {
+template<typename filter_t>
+void add_hashes_to_filter(const IndexArguments &opt, const InputSummary &summary,
+                          const std::unordered_map<uint8_t, std::vector<uint8_t>> &bucket_to_bins_map,
+                          filter_t &filter) {
+#pragma omp parallel for
+    for (uint8_t bucket = 0; bucket < summary.num_bins; ++bucket) {
+        const auto &bins = bucket_to_bins_map.at(bucket);
+        for (auto const &bin: bins) {
+            const auto &hashes = load_hashes(std::to_string(bin), opt.tmp_dir);
+#pragma omp critical
+            for (auto &&value: hashes) {
+                if constexpr (std::is_same_v<filter_t, seqan3::interleaved_bloom_filter<>>)
+                    filter.emplace(value, seqan3::bin_index{bucket});
+                else
+                    filter.emplace(value, bucket);
+            }
+            PLOG_DEBUG << "Added " << hashes.size() << " hashes to bin " << +bucket;
+        }
+        delete_hashes(bins, opt.tmp_dir);
+    }
+}
+
+Index build_blocked_index(const IndexArguments &opt, const InputSummary &summary, InputStats &stats,
+                          const std::unordered_map<uint8_t, std::vector<uint8_t>> &bucket_to_bins_map) {
     const auto max_num_hashes = stats.max_num_hashes();
+    const auto positions_per_block = BlockedBloomFilter::positions_per_block(summary.num_bins);
+    const auto ibf_bits = bin_size_in_bits(opt, max_num_hashes);
+    const auto num_bits = blocked_bin_size_in_bits(opt, max_num_hashes, positions_per_block);
+    PLOG_INFO << "Create new blocked filter with " << +summary.num_bins << " bins and " << +num_bits << " bits";
+    BlockedBloomFilter filter{summary.num_bins, num_bits, opt.num_hash};
+    PLOG_INFO << "Blocked filter with " << +positions_per_block << " positions per block has a false positive rate of "
+              << filter.false_positive_rate(max_num_hashes) << " in its fullest bin, an IBF would have "
+              << false_positive_rate(max_num_hashes, ibf_bits, opt.num_hash) << " with " << ibf_bits
+              << " bits per bin, the blocked filter uses " << static_cast<double>(num_bits) / ibf_bits << " times as many";
+    add_hashes_to_filter(opt, summary, bucket_to_bins_map, filter);
+
+    return Index(opt, summary, stats, std::move(filter));
+}
+
+Index build_exact_index(const IndexArguments &opt, const InputSummary &summary, InputStats &stats,
+                        const std::unordered_map<uint8_t, std::vector<uint8_t>> &bucket_to_bins_map) {
+    uint64_t max_num_keys = 0;
+    for (const auto &[bin, num_hashes]: stats.hashes_per_bin)
+        max_num_keys += num_hashes;
+    PLOG_INFO << "Create new exact index with " << +summary.num_bins << " bins for at most " << max_num_keys
+              << " minimisers";
+    ExactIndex exact{summary.num_bins, max_num_keys};
+    add_hashes_to_filter(opt, summary, bucket_to_bins_map, exact);
+    PLOG_INFO << "Exact index holds " << exact.size() << " distinct minimisers";
+
+    return Index(opt, summary, stats, std::move(exact));
+}
+
+seqan3::interleaved_bloom_filter<seqan3::data_layout::uncompressed>
+build_triage_ibf(const IndexArguments &opt, const InputSummary &summary, InputStats &stats,
+                 const std::unordered_map<uint8_t, std::vector<uint8_t>> &bucket_to_bins_map) {
+    const auto max_num_hashes = stats.max_num_hashes() / opt.triage_rate + 1;
     const auto num_bits = bin_size_in_bits(opt, max_num_hashes);
-    PLOG_INFO << "Create new IBF with " << +summary.num_bins << " bins and " << +num_bits << " bits";
+    PLOG_INFO << "Create triage IBF from 1 in " << opt.triage_rate << " minimisers with " << +summary.num_bins
+              << " bins and " << +num_bits << " bits";
     seqan3::interleaved_bloom_filter ibf{seqan3::bin_count{summary.num_bins},
                                          seqan3::bin_size{num_bits},
                                          seqan3::hash_function_count{opt.num_hash}};
@@ -251,13 +331,93 @@ Index build_index(const IndexArguments &opt, const InputSummary &summary, InputS
             const auto &hashes = load_hashes(std::to_string(bin), opt.tmp_dir);
 #pragma omp critical
             for (auto &&value: hashes) {
-                ibf.emplace(value, seqan3::bin_index{bucket});
+                if (in_subsample(value, opt.triage_rate))
+                    ibf.emplace(value, seqan3::bin_index{bucket});
             }
-            PLOG_DEBUG << "Added " << hashes.size() << " hashes to bin " << +bucket;
         }
-        delete_hashes(bins, opt.tmp_dir);
     }
 
+    return ibf;
+}
+
+SingleBinBlockedBloomFilter
+build_host_prefilter(const IndexArguments &opt, const InputSummary &summary,
+                     const std::unordered_map<uint8_t, std::vector<uint8_t>> &bucket_to_bins_map) {
+    const auto host_index = std::min(summary.category_index("host"), summary.category_index("human"));
+    if (host_index == std::numeric_limits<uint8_t>::max()) {
+        PLOG_WARNING << "Index does not contain 'host' or 'human' as a category, not building a host prefilter";
+        return SingleBinBlockedBloomFilter{};
+    }
+
+    // sampled minimisers found in any other category, which must be left out of the prefilter
+    PLOG_INFO << "Collect 1 in " << opt.prefilter_rate << " minimisers from non-host bins";
+    std::unordered_set<uint64_t> other_hashes;
+    for (uint8_t bucket = 0; bucket < summary.num_bins; ++bucket) {
+        if (summary.category_index(summary.bin_to_category.at(bucket)) == host_index)
+            continue;
+        for (auto const &bin: bucket_to_bins_map.at(bucket)) {
+            for (auto &&value: load_hashes(std::to_string(bin), opt.tmp_dir)) {
+                if (in_subsample(value, opt.prefilter_rate))
+                    other_hashes.insert(value);
+            }
+        }
+    }
+
+    std::unordered_set<uint64_t> host_hashes;
+    for (uint8_t bucket = 0; bucket < summary.num_bins; ++bucket) {
+        if (summary.category_index(summary.bin_to_category.at(bucket)) != host_index)
+            continue;
+        for (auto const &bin: bucket_to_bins_map.at(bucket)) {
+            for (auto &&value: load_hashes(std::to_string(bin), opt.tmp_dir)) {
+                if (in_subsample(value, opt.prefilter_rate) and not other_hashes.contains(value))
+                    host_hashes.insert(value);
+            }
+        }
+    }
+
+    // sized for max_fpr, but no larger than the last level cache as it is only of use while it stays there
+    auto num_bits = blocked_bin_size_in_bits(opt, host_hashes.size() + 1,
+                                             SingleBinBlockedBloomFilter::positions_per_block);
+    const auto cache_bytes = last_level_cache_in_bytes();
+    if (cache_bytes > 0 and num_bits / 8 > cache_bytes) {
+        PLOG_WARNING << "Host prefilter needs " << num_bits / 8e6 << "MB for max_fpr " << opt.max_fpr
+                     << " but the last level cache is " << cache_bytes / 1e6
+                     << "MB, limiting it to the cache size. Use a larger --prefilter rate to stay within max_fpr";
+        num_bits = cache_bytes * 8;
+    }
+    PLOG_INFO << "Create host prefilter from " << host_hashes.size() << " host-unique minimisers with " << +num_bits
+              << " bits";
+    SingleBinBlockedBloomFilter prefilter{num_bits, opt.num_hash};
+    for (const auto &value: host_hashes)
+        prefilter.emplace(value);
+
+    PLOG_INFO << "Host prefilter uses " << prefilter.size_in_bytes() / 1e6 << "MB with a false positive rate of "
+              << prefilter.false_positive_rate(host_hashes.size());
+    if (cache_bytes == 0)
+        PLOG_INFO << "Last level cache size is unknown, cannot check whether the host prefilter fits in it";
+    else if (prefilter.size_in_bytes() <= cache_bytes)
+        PLOG_INFO << "Host prefilter fits in the " << cache_bytes / 1e6 << "MB last level cache of this machine";
+    else
+        PLOG_WARNING << "Host prefilter does not fit in the " << cache_bytes / 1e6
+                     << "MB last level cache of this machine";
+
+    return prefilter;
+}
+
+Index build_index(const IndexArguments &opt, const InputSummary &summary, InputStats &stats,
+                  const std::unordered_map<uint8_t, std::vector<uint8_t>> &bucket_to_bins_map) {
+    if (opt.blocked)
+        return build_blocked_index(opt, summary, stats, bucket_to_bins_map);
+    else if (opt.exact)
+        return build_exact_index(opt, summary, stats, bucket_to_bins_map);
+
+    const auto max_num_hashes = stats.max_num_hashes();
+    const auto num_bits = bin_size_in_bits(opt, max_num_hashes);
+    PLOG_INFO << "Create new IBF with " << +summary.num_bins << " bins and " << +num_bits << " bits";
+    seqan3::interleaved_bloom_filter ibf{seqan3::bin_count{summary.num_bins},
+                                         seqan3::bin_size{num_bits},
+                                         seqan3::hash_function_count{opt.num_hash}};
+    add_hashes_to_filter(opt, summary, bucket_to_bins_map, ibf);
 
     return Index(opt, summary, stats, ibf);
 }
@@ -297,7 +457,17 @@ int index_main(IndexArguments &opt) {
     auto summary = parse_input_file(opt.input_file);
     auto stats = count_and_store_hashes(opt, summary);
     auto bucket_to_bins_map = optimize_layout(opt, summary, stats);
+    seqan3::interleaved_bloom_filter<seqan3::data_layout::uncompressed> triage_ibf{};
+    if (opt.triage_rate > 0)
+        triage_ibf = build_triage_ibf(opt, summary, stats, bucket_to_bins_map);
+    SingleBinBlockedBloomFilter prefilter{};
+    if (opt.prefilter_rate > 0)
+        prefilter = build_host_prefilter(opt, summary, bucket_to_bins_map);
     auto index = build_index(opt, summary, stats, bucket_to_bins_map);
+    if (opt.triage_rate > 0)
+        index.set_triage(opt.triage_rate, std::move(triage_ibf));
+    if (not prefilter.empty())
+        index.set_prefilter(opt.prefilter_rate, std::move(prefilter));
 
     store_index(opt.prefix, std::move(index));
 
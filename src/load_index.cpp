@@ -4,6 +4,7 @@
 #include <plog/Log.h>
 
 #include <load_index.hpp>
+#include <utils.hpp>
 
 void load_index(Index &index, std::filesystem::path const &path) {
     PLOG_INFO << "Loading index from file " << path;
@@ -13,3 +14,45 @@ void load_index(Index &index, std::filesystem::path const &path) {
     PLOG_INFO << "Index loaded";
     //PLOG_DEBUG << "Index has " << index.ibf().bin_count() << " bins and " << index.ibf().bit_size() << " bits";
 }
+
+void set_index_layout(Index &index, const std::string &layout, std::filesystem::path const &path,
+                      const uint8_t threads) {
+    if (index.layout() == IndexLayout::blocked or index.layout() == IndexLayout::exact) {
+        PLOG_INFO << "Index was built with the " << layout_name(index.layout()) << " layout using "
+                  << index.uncompressed_size_in_bytes() / 1e9 << "GB, ignoring layout " << layout;
+        return;
+    }
+
+    // the in-memory size of the compressed IBF is not exposed by seqan3, the serialized file is the closest measure
+    const auto file_bytes = std::filesystem::file_size(path);
+    const auto uncompressed_bytes = index.uncompressed_size_in_bytes();
+    const auto available_bytes = available_memory_in_bytes();
+    PLOG_INFO << "Index file is " << file_bytes / 1e9 << "GB, the uncompressed layout needs "
+              << uncompressed_bytes / 1e9 << "GB and " << available_bytes / 1e9 << "GB of memory are available";
+
+    if (layout == "compressed")
+        return;
+
+    // leave some headroom for reads and results when deciding automatically
+    if (layout == "auto" and uncompressed_bytes > 0.9 * available_bytes) {
+        PLOG_INFO << "Insufficient memory for the uncompressed layout, using the compressed layout";
+        return;
+    }
+
+    if (uncompressed_bytes > available_bytes)
+        PLOG_WARNING << "Uncompressed layout requested but it exceeds the available memory";
+    index.decompress(threads);
+}
+
+void load_indexes(IndexSet &indexes, const std::vector<std::string> &paths, const std::string &layout,
+                  const uint8_t threads) {
+    for (const auto &path: paths) {
+        auto index = Index();
+        load_index(index, path);
+        set_index_layout(index, layout, path, threads);
+        indexes.add(std::move(index));
+    }
+    if (paths.size() > 1)
+        PLOG_INFO << "Combined " << paths.size() << " indexes with " << +indexes.num_bins() << " bins in "
+                  << +indexes.num_categories() << " categories";
+}
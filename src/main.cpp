@@ -5,6 +5,7 @@
 #include "index_main.hpp"
 #include "classify_main.hpp"
 #include "dehost_main.hpp"
+#include "extract_main.hpp"
 #include "version.h"
 
 class MyFormatter : public CLI::Formatter {
@@ -56,6 +57,7 @@ int main(int argc, char *argv[]) {
     setup_index_subcommand(app);
     setup_classify_subcommand(app);
     setup_dehost_subcommand(app);
+    setup_extract_subcommand(app);
 
 
     app.require_subcommand();
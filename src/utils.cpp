@@ -1,5 +1,11 @@
 #include "utils.hpp"
 #include "index_main.hpp"
+#include "blocked_bloom_filter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <unistd.h>
 
 #include <plog/Log.h>
 #include <gzip/compress.hpp>
@@ -89,6 +95,54 @@ size_t bin_size_in_bits(const IndexArguments &opt, const uint64_t &num_elements)
     return result;
 }
 
+double false_positive_rate(const uint64_t num_elements, const uint64_t num_bits, const uint8_t num_hash) {
+    /*
+     * expected false positive rate of a (non-blocked) Bloom filter bin, as used by the IBF
+     */
+    if (num_bits == 0)
+        return 1.0;
+    return std::pow(1 - std::exp(-static_cast<double>(num_elements) * num_hash / num_bits), num_hash);
+}
+
+size_t blocked_bin_size_in_bits(const IndexArguments &opt, const uint64_t &num_elements,
+                                const uint32_t positions_per_block) {
+    /*
+     * positions per bin for a blocked Bloom filter to stay within max_fpr. Elements fall unevenly into the blocks, so
+     * this is more than an IBF needs, by a factor which grows as the blocks get smaller
+     */
+    assert(opt.max_fpr > 0.0);
+    assert(opt.max_fpr < 1.0);
+
+    const auto fpr = [&](const uint64_t num_blocks) {
+        return blocked_false_positive_rate(num_elements, num_blocks, positions_per_block, opt.num_hash);
+    };
+
+    // double from the size an unblocked filter would need, then bisect down to the fewest blocks within max_fpr
+    double const ibf_bits{std::ceil(-static_cast<double>(num_elements * opt.num_hash) /
+                                    std::log(1 - std::exp(std::log(opt.max_fpr) / opt.num_hash)))};
+    uint64_t num_blocks = std::max<uint64_t>(1, ibf_bits / positions_per_block);
+    uint64_t lower = 0;
+    while (fpr(num_blocks) > opt.max_fpr) {
+        lower = num_blocks;
+        num_blocks *= 2;
+    }
+    while (num_blocks - lower > 1) {
+        const auto middle = lower + (num_blocks - lower) / 2;
+        if (fpr(middle) > opt.max_fpr)
+            lower = middle;
+        else
+            num_blocks = middle;
+    }
+
+    double const result{static_cast<double>(num_blocks) * positions_per_block};
+    if (result > opt.bits) {
+        PLOG_WARNING << "Require " << +result << " bits for max_fpr " << opt.max_fpr << " with blocks of "
+                     << positions_per_block << " positions but only have " << +opt.bits << " bits available";
+        return opt.bits;
+    }
+    return result;
+}
+
 size_t max_num_hashes_for_fpr(const IndexArguments &opt) {
     assert(opt.bits > 0);
     assert(opt.max_fpr > 0.0);
@@ -131,3 +185,117 @@ std::string get_extension(const std::filesystem::path read_file) {
     }
     return ext;
 }
+
+uint64_t available_memory_in_bytes() {
+    /*
+     * memory which can be allocated without swapping: MemAvailable on linux, otherwise total physical memory
+     */
+    std::ifstream meminfo{"/proc/meminfo"};
+    std::string line;
+    while (std::getline(meminfo, line)) {
+        if (starts_with(line, "MemAvailable:")) {
+            std::istringstream fields{line.substr(13)};
+            uint64_t kilobytes = 0;
+            fields >> kilobytes;
+            return kilobytes * 1024;
+        }
+    }
+    return static_cast<uint64_t>(sysconf(_SC_PHYS_PAGES)) * static_cast<uint64_t>(sysconf(_SC_PAGE_SIZE));
+}
+
+uint64_t last_level_cache_in_bytes() {
+    /*
+     * size of the largest cache reported for this machine, or 0 if it is unknown
+     */
+    long bytes = 0;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    if (bytes <= 0)
+        bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    return bytes > 0 ? bytes : 0;
+}
+
+void log_lookup_rate(const std::string &layout, const uint64_t num_lookups, const double seconds) {
+    /*
+     * report the per-thread rate at which minimisers were hashed and queried against the index
+     */
+    if (seconds <= 0)
+        return;
+    PLOG_INFO << "Hashed and queried " << num_lookups << " minimisers against the " << layout << " index in "
+              << seconds << " thread seconds (" << static_cast<uint64_t>(num_lookups / seconds)
+              << " lookups/s per thread)";
+}
+
+void log_filter_summary(const uint64_t num_filtered, const uint64_t num_bases, const uint64_t num_lookups,
+                        const uint8_t kmer_size, const uint8_t window_size) {
+    /*
+     * report how many reads failed the quality, length or compression filters and so were never hashed or looked up,
+     * estimating the lookups avoided from the expected density of 2 / (w - k + 2) minimisers per base
+     */
+    if (num_filtered == 0)
+        return;
+    const auto num_avoided = static_cast<uint64_t>(2.0 * num_bases / (window_size - kmer_size + 2));
+    PLOG_INFO << "Filters rejected " << num_filtered << " reads (" << num_bases << " bases) before any lookups, avoiding "
+              << "about " << num_avoided << " lookups (" << 100.0 * num_avoided / (num_avoided + num_lookups)
+              << "% of the total)";
+}
+
+void log_thread_utilisation(const std::vector<double> &busy_seconds, const double wall_seconds) {
+    /*
+     * report the fraction of the time each worker thread spent processing reads rather than waiting for work
+     */
+    if (busy_seconds.empty() or wall_seconds <= 0)
+        return;
+    double total_busy = 0;
+    for (auto i = 0; i < busy_seconds.size(); ++i) {
+        PLOG_DEBUG << "Thread " << i << " busy for " << busy_seconds[i] << "s of " << wall_seconds << "s";
+        total_busy += busy_seconds[i];
+    }
+    const auto [min_busy, max_busy] = std::minmax_element(busy_seconds.begin(), busy_seconds.end());
+    PLOG_INFO << "Worker threads were busy " << 100.0 * total_busy / (busy_seconds.size() * wall_seconds)
+              << "% of " << wall_seconds << "s (per thread " << 100.0 * *min_busy / wall_seconds << "% to "
+              << 100.0 * *max_busy / wall_seconds << "%)";
+}
+
+void log_prefilter_summary(const uint64_t num_checked, const uint64_t num_prefiltered) {
+    /*
+     * report how many reads checked against the host prefilter were called without the full index
+     */
+    if (num_checked == 0)
+        return;
+    PLOG_INFO << "Host prefilter called " << num_prefiltered << " of " << num_checked << " reads ("
+              << 100.0 * num_prefiltered / num_checked << "%) without the full index";
+}
+
+void log_cascade_summary(const uint64_t num_triaged, const uint64_t num_second_tier) {
+    /*
+     * report how many reads queried with the triage index also needed the full index
+     */
+    if (num_triaged == 0)
+        return;
+    PLOG_INFO << "Triage index called " << num_triaged - num_second_tier << " of " << num_triaged
+              << " reads, " << 100.0 * num_second_tier / num_triaged << "% needed the full index";
+}
+
+void log_subsample_summary(const uint64_t num_subsampled, const uint32_t max_minimisers) {
+    /*
+     * report how many reads were called from a subsample of their minimisers
+     */
+    if (max_minimisers == 0)
+        return;
+    PLOG_INFO << num_subsampled << " reads had more than " << max_minimisers
+              << " minimisers and were called from a subsample";
+}
+
+void log_early_stop_summary(const uint64_t num_minimisers, const uint64_t num_used, const uint64_t num_stopped_early) {
+    /*
+     * report how many minimisers were looked up by the reads which went through the sequential test
+     */
+    if (num_minimisers == 0)
+        return;
+    PLOG_INFO << "Looked up " << num_used << " of " << num_minimisers << " minimisers ("
+              << 100.0 * num_used / num_minimisers << "%), " << num_stopped_early << " reads stopped early";
+}